@@ -0,0 +1,149 @@
+/*
+ *  bench.h
+ *  Shared helpers for the mars benchmark executable.
+ */
+#ifndef MARS_BENCH_H
+#define MARS_BENCH_H
+
+#include "mars/mars.h"
+
+/*=======================================================*/
+/* Timing                                                */
+/*=======================================================*/
+#if defined(_WIN32)
+  static inline double bench_now() {
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+  }
+#else
+  #include <time.h>
+  static inline double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (ts.tv_nsec * 1e-9);
+  }
+#endif
+
+
+/*=======================================================*/
+/* Measurement                                           */
+/*=======================================================*/
+
+// Allocator that counts every malloc & realloc it forwards, including growth
+typedef struct {
+  allocator base;
+  volatile size_t allocs;   // Calls to alloc & realloc so far
+} BenchAllocator;
+
+static void* bench_allocator_alloc(void* user, size_t size) {
+  mars_atomic_add(&((BenchAllocator*)user)->allocs, 1);
+  return malloc(size);
+}
+
+static void* bench_allocator_realloc(void* user, void* ptr, size_t old_size, size_t new_size) {
+  mars_atomic_add(&((BenchAllocator*)user)->allocs, 1);
+  return realloc(ptr, new_size);
+}
+
+static void bench_allocator_free(void* user, void* ptr, size_t size) {
+  free(ptr);
+}
+
+static inline void bench_allocator_init(BenchAllocator* counter) {
+  counter->base.alloc = bench_allocator_alloc;
+  counter->base.realloc = bench_allocator_realloc;
+  counter->base.free = bench_allocator_free;
+  counter->base.user = counter;
+  counter->allocs = 0;
+}
+
+// Time & allocations summed over the measured sections of one benchmark row
+typedef struct {
+  double elapsed;       // Seconds spent measuring
+  size_t allocs;        // Allocations made while measuring
+  size_t ops;           // Operations measured
+  double start;         // Start of the running section
+  size_t start_allocs;  // Allocation count at the start of the running section
+} BenchTimer;
+
+static inline void bench_start(BenchTimer* timer, BenchAllocator* counter) {
+  timer->start_allocs = mars_atomic_load(&counter->allocs);
+  timer->start = bench_now();
+}
+
+static inline void bench_stop(BenchTimer* timer, BenchAllocator* counter, size_t ops) {
+  timer->elapsed += bench_now() - timer->start;
+  timer->allocs += mars_atomic_load(&counter->allocs) - timer->start_allocs;
+  timer->ops += ops;
+}
+
+// Print one row as ns/op & allocs/op
+static inline void bench_print(const char* name, size_t size, BenchTimer* timer) {
+  size_t ops = (timer->ops > 0) ? timer->ops : 1;
+  printf("  %-22s %9zu %10.2f ns/op %9.4f allocs/op\n", name, size, timer->elapsed * 1e9 / (double)ops, (double)timer->allocs / (double)ops);
+}
+
+// Deterministic 64-bit key stream (splitmix64)
+static inline uint64_t bench_key(uint64_t* state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return (z ^ (z >> 31)) & (ID_NULL - 1);
+}
+
+
+/*=======================================================*/
+/* Benchmarks                                            */
+/*=======================================================*/
+typedef struct {
+  size_t count;       // Number of elements per benchmark
+  size_t iterations;  // Number of repetitions per benchmark
+  size_t threads;     // Number of worker threads for parallel benchmarks
+} BenchConfig;
+
+// Sizes swept by the scaling benchmarks: count / 1000, count / 10 & count
+static inline void bench_sizes(BenchConfig* config, size_t sizes[3]) {
+  sizes[0] = (config->count / 1000 > 0) ? config->count / 1000 : 1;
+  sizes[1] = (config->count / 10 > 0) ? config->count / 10 : 1;
+  sizes[2] = config->count;
+}
+
+// Passes over a size, so every size does about iterations * count / 100 operations
+static inline size_t bench_passes(BenchConfig* config, size_t size) {
+  size_t passes = (config->iterations * (config->count / size)) / 100;
+  return (passes > 0) ? passes : 1;
+}
+
+// Transform integration throughput per instruction set
+void bench_transform(BenchConfig*);
+
+// Two-component walk with sparse-set versus archetype storage
+void bench_archetype(BenchConfig*);
+
+// Entity spawn cost: one call per entity & component versus one bulk call
+void bench_entity_spawn(BenchConfig*);
+
+// Entity despawn cost: probing every system, one at a time & batched
+void bench_entity_destroy_batch(BenchConfig*);
+
+// unordered_map hit & miss lookup latency per load factor
+void bench_umap_lookup(BenchConfig*);
+
+// unordered_map lookup latency per hash function, random & sequential keys
+void bench_umap_hash(BenchConfig*);
+
+// unordered_map memory & speed under steady insert/delete churn
+void bench_umap_churn(BenchConfig*);
+
+// unordered_map insert, find, iterate & delete per size & load factor
+void bench_containers_umap(BenchConfig*);
+
+// vector & stack push/pop and lot insert/delete per size
+void bench_containers_sequence(BenchConfig*);
+
+// Entity creation, component lookup & full ticks per entity count
+void bench_engine_ops(BenchConfig*);
+
+#endif  // MARS_BENCH_H
\ No newline at end of file
@@ -0,0 +1,109 @@
+/*
+ *  bench_archetype.c
+ *  Measures a two-component walk (transform + velocity) with sparse-set storage,
+ *  where the second component is looked up per entity, against archetype storage,
+ *  where both are read side by side from the same chunk, either matching archetypes
+ *  every tick or through a cached query.
+ */
+#include "bench.h"
+
+typedef struct {
+  float x;
+  float y;
+} BenchVelocity;
+
+// Build an engine where every entity has a transform and three in four have a velocity,
+// returning the systems and the first entity
+static Engine* bench_archetype_engine(size_t count, uint8_t storage, mars_id_t* transform, mars_id_t* velocity, mars_id_t* first) {
+  Engine* engine = engine_create(NULL, NULL, 0, NULL);
+  if (!engine) { return NULL; }
+  *transform = engine_new_system(engine, sizeof(ComponentTransform), NULL, NULL, NULL);
+  *velocity = engine_new_system(engine, sizeof(BenchVelocity), NULL, NULL, NULL);
+  engine_set_system_storage(engine, *transform, storage);
+  engine_set_system_storage(engine, *velocity, storage);
+  for (size_t i = 0; i < count; ++i) {
+    mars_id_t entity_id = engine_new_entity(engine);
+    ComponentTransform t = { entity_id, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    BenchVelocity v = { 1.0f, (float)(i & 7) };
+    engine_add_entity_component(engine, *transform, entity_id, &t);
+    if (i % 4 != 3) {
+      engine_add_entity_component(engine, *velocity, entity_id, &v);
+    }
+    if (i == 0) { *first = entity_id; }
+  }
+  return engine;
+}
+
+void bench_archetype(BenchConfig* config) {
+  const float dt = 1.0f / 60.0f;
+  printf("\n[archetype] %zu entities, %zu ticks, transform + velocity\n", config->count, config->iterations);
+
+  // Walk the transforms, looking up each entity's velocity
+  mars_id_t transform, velocity, first;
+  Engine* engine = bench_archetype_engine(config->count, MARS_STORAGE_SPARSE, &transform, &velocity, &first);
+  if (!engine) { return; }
+  System* transforms = engine_get_system(engine, transform);
+  System* velocities = engine_get_system(engine, velocity);
+  double start = bench_now();
+  for (size_t i = 0; i < config->iterations; ++i) {
+    mars_id_t* entities = vector_data(transforms->entities);
+    ComponentTransform* t = vector_data(transforms->components);
+    for (size_t k = 0; k < transforms->components->length; ++k) {
+      BenchVelocity* v = system_get_component(velocities, entities[k]);
+      if (v) {
+        t[k].x += v->x * dt;
+        t[k].y += v->y * dt;
+      }
+    }
+  }
+  double elapsed = bench_now() - start;
+  ComponentTransform expect = *(ComponentTransform*)engine_get_entity_component(engine, transform, first);
+  printf("  %-12s %10.2f ns/entity\n", "sparse", elapsed * 1e9 / (double)(config->count * config->iterations));
+  engine_destroy(engine);
+
+  // Walk every chunk holding both
+  engine = bench_archetype_engine(config->count, MARS_STORAGE_ARCHETYPE, &transform, &velocity, &first);
+  if (!engine) { return; }
+  mars_id_t query_ids[] = { transform, velocity };
+  start = bench_now();
+  for (size_t i = 0; i < config->iterations; ++i) {
+    ArchetypeIter it;
+    for (engine_archetype_iter(engine, &it, query_ids, 2); !archetype_iter_done(&it); archetype_iter_next(&it)) {
+      ComponentTransform* t = it.columns[0];
+      BenchVelocity* v = it.columns[1];
+      for (size_t k = 0; k < it.length; ++k) {
+        t[k].x += v[k].x * dt;
+        t[k].y += v[k].y * dt;
+      }
+    }
+  }
+  elapsed = bench_now() - start;
+  ComponentTransform* result = engine_get_entity_component(engine, transform, first);
+  printf("  %-12s %10.2f ns/entity%s\n", "archetype", elapsed * 1e9 / (double)(config->count * config->iterations),
+    (result && result->x == expect.x && result->y == expect.y) ? "" : "  (result mismatch!)");
+  engine_destroy(engine);
+
+  // Same walk through a query built once
+  engine = bench_archetype_engine(config->count, MARS_STORAGE_ARCHETYPE, &transform, &velocity, &first);
+  if (!engine) { return; }
+  query_ids[0] = transform;
+  query_ids[1] = velocity;
+  Query* query = engine_new_query(engine, query_ids, 2, NULL, 0);
+  start = bench_now();
+  for (size_t i = 0; i < config->iterations; ++i) {
+    ArchetypeIter it;
+    for (query_iter(query, &it); !archetype_iter_done(&it); archetype_iter_next(&it)) {
+      ComponentTransform* t = it.columns[0];
+      BenchVelocity* v = it.columns[1];
+      for (size_t k = 0; k < it.length; ++k) {
+        t[k].x += v[k].x * dt;
+        t[k].y += v[k].y * dt;
+      }
+    }
+  }
+  elapsed = bench_now() - start;
+  result = engine_get_entity_component(engine, transform, first);
+  printf("  %-12s %10.2f ns/entity%s\n", "query", elapsed * 1e9 / (double)(config->count * config->iterations),
+    (result && result->x == expect.x && result->y == expect.y) ? "" : "  (result mismatch!)");
+  engine_destroy(engine);
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+/*
+ *  bench_containers.c
+ *  Measures the container hot paths at three sizes: unordered_map insert, find,
+ *  iterate and delete per load factor, vector and stack push and pop, and lot
+ *  insert and delete. Every container starts at its default capacity, so growth
+ *  shows up in both ns/op and allocs/op.
+ */
+#include "bench.h"
+
+void bench_containers_umap(BenchConfig* config) {
+  const float loads[] = { 0.5f, 0.75f, 0.875f };
+  const char* names[] = { "insert", "find", "iterate", "delete" };
+  size_t sizes[3];
+  bench_sizes(config, sizes);
+  printf("\n[umap ops] random keys, growing from the default capacity\n");
+
+  mars_id_t* keys = malloc(sizeof(mars_id_t) * config->count);
+  if (!keys) { return; }
+  BenchAllocator counter;
+  bench_allocator_init(&counter);
+  for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); ++l) {
+    printf("  load %.3f\n", loads[l]);
+    for (size_t s = 0; s < 3; ++s) {
+      size_t size = sizes[s];
+      size_t passes = bench_passes(config, size);
+      BenchTimer timers[4] = { 0 };
+      size_t mismatches = 0;
+      for (size_t p = 0; p < passes; ++p) {
+        unordered_map* umap = unordered_map_create_alloc(mars_id_t, &counter.base);
+        if (!umap) { break; }
+        unordered_map_set_load(umap, loads[l]);
+        uint64_t state = p + 1;
+        for (size_t i = 0; i < size; ++i) {
+          keys[i] = (mars_id_t)bench_key(&state);
+        }
+
+        // Insert
+        bench_start(&timers[0], &counter);
+        for (size_t i = 0; i < size; ++i) {
+          unordered_map_insert(umap, keys[i], &keys[i]);
+        }
+        bench_stop(&timers[0], &counter, size);
+
+        // Find
+        size_t found = 0;
+        bench_start(&timers[1], &counter);
+        for (size_t i = 0; i < size; ++i) {
+          found += (unordered_map_find(umap, keys[i]) != NULL);
+        }
+        bench_stop(&timers[1], &counter, size);
+
+        // Iterate
+        size_t visited = 0;
+        bench_start(&timers[2], &counter);
+        unordered_map_foreach(umap, it) {
+          visited += (*(mars_id_t*)it.data == it.key);
+        }
+        bench_stop(&timers[2], &counter, size);
+
+        // Delete
+        bench_start(&timers[3], &counter);
+        for (size_t i = 0; i < size; ++i) {
+          unordered_map_delete(umap, keys[i]);
+        }
+        bench_stop(&timers[3], &counter, size);
+        mismatches += (found != size) + (visited != found) + (umap->length != 0);
+        unordered_map_destroy(umap);
+      }
+      for (size_t t = 0; t < 4; ++t) {
+        bench_print(names[t], size, &timers[t]);
+      }
+      if (mismatches > 0) { printf("  (umap mismatch!)\n"); }
+    }
+  }
+  free(keys);
+}
+
+void bench_containers_sequence(BenchConfig* config) {
+  size_t sizes[3];
+  bench_sizes(config, sizes);
+  printf("\n[sequence ops] 8-byte elements, growing from the default capacity\n");
+
+  BenchAllocator counter;
+  bench_allocator_init(&counter);
+  for (size_t s = 0; s < 3; ++s) {
+    size_t size = sizes[s];
+    size_t passes = bench_passes(config, size);
+    BenchTimer timers[6] = { 0 };
+    size_t mismatches = 0;
+    for (size_t p = 0; p < passes; ++p) {
+      // vector push_back & pop_back
+      vector* vec = vector_create_alloc(uint64_t, &counter.base);
+      if (!vec) { break; }
+      bench_start(&timers[0], &counter);
+      for (uint64_t i = 0; i < size; ++i) {
+        vector_push_back(vec, &i);
+      }
+      bench_stop(&timers[0], &counter, size);
+      mismatches += (vec->length != size);
+      bench_start(&timers[1], &counter);
+      for (size_t i = 0; i < size; ++i) {
+        vector_pop_back(vec);
+      }
+      bench_stop(&timers[1], &counter, size);
+      mismatches += (vec->length != 0);
+      vector_destroy(vec);
+
+      // stack push & pop
+      stack* stk = stack_create_alloc(uint64_t, &counter.base);
+      if (!stk) { break; }
+      bench_start(&timers[2], &counter);
+      for (uint64_t i = 0; i < size; ++i) {
+        stack_push(stk, &i);
+      }
+      bench_stop(&timers[2], &counter, size);
+      mismatches += (stk->length != size);
+      bench_start(&timers[3], &counter);
+      for (size_t i = 0; i < size; ++i) {
+        stack_pop(stk);
+      }
+      bench_stop(&timers[3], &counter, size);
+      mismatches += (stk->length != 0);
+      stack_destroy(stk);
+
+      // lot insert & delete, keys are written to a vector reserved up front
+      lot* lt = lot_create_alloc(uint64_t, &counter.base);
+      vector* lot_keys = vector_create(__lot_key_t);
+      if (!lt || !lot_keys || vector_reserve(lot_keys, size) > 0) {
+        lot_destroy(lt);
+        vector_destroy(lot_keys);
+        break;
+      }
+      __lot_key_t* k = vector_data(lot_keys);
+      bench_start(&timers[4], &counter);
+      for (uint64_t i = 0; i < size; ++i) {
+        lot_insert(lt, &k[i], &i);
+      }
+      bench_stop(&timers[4], &counter, size);
+      mismatches += (lt->length != size);
+      bench_start(&timers[5], &counter);
+      for (size_t i = 0; i < size; ++i) {
+        lot_delete(lt, k[i]);
+      }
+      bench_stop(&timers[5], &counter, size);
+      mismatches += (lt->length != 0);
+      lot_destroy(lt);
+      vector_destroy(lot_keys);
+    }
+    bench_print("vector push_back", size, &timers[0]);
+    bench_print("vector pop_back", size, &timers[1]);
+    bench_print("stack push", size, &timers[2]);
+    bench_print("stack pop", size, &timers[3]);
+    bench_print("lot insert", size, &timers[4]);
+    bench_print("lot delete", size, &timers[5]);
+    if (mismatches > 0) { printf("  (sequence mismatch!)\n"); }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+/*
+ *  bench_engine.c
+ *  Measures the engine hot paths at three entity counts: creating entities, adding a
+ *  transform to each, looking components up in random order through
+ *  engine_get_entity_component, and full engine_step ticks on one thread and across
+ *  the worker pool. All engine memory goes through a counting allocator.
+ */
+#include "bench.h"
+
+void bench_engine_ops(BenchConfig* config) {
+  size_t sizes[3];
+  bench_sizes(config, sizes);
+  printf("\n[engine ops] transform component, %zu worker threads\n", config->threads);
+
+  mars_id_t* entities = malloc(sizeof(mars_id_t) * config->count);
+  if (!entities) { return; }
+  BenchAllocator counter;
+  bench_allocator_init(&counter);
+  ComponentTransform transform = { ID_NULL, 0.0f, 0.0f, 1.0f, 1.0f, 0.5f };
+  for (size_t s = 0; s < 3; ++s) {
+    size_t size = sizes[s];
+    size_t passes = bench_passes(config, size);
+    BenchTimer timers[5] = { 0 };
+    size_t mismatches = 0;
+    for (size_t p = 0; p < passes; ++p) {
+      Engine* engine = engine_create_alloc(NULL, NULL, 0, NULL, &counter.base);
+      if (!engine) { break; }
+      mars_id_t system_id = engine_new_system(engine, sizeof(ComponentTransform), component_transform_init, NULL, NULL);
+      System* system = engine_get_system(engine, system_id);
+      system->update_batch = component_transform_update_batch;
+
+      // Create entities
+      bench_start(&timers[0], &counter);
+      for (size_t i = 0; i < size; ++i) {
+        entities[i] = engine_new_entity(engine);
+      }
+      bench_stop(&timers[0], &counter, size);
+
+      // Give each a transform
+      bench_start(&timers[1], &counter);
+      for (size_t i = 0; i < size; ++i) {
+        engine_add_entity_component(engine, system_id, entities[i], &transform);
+      }
+      bench_stop(&timers[1], &counter, size);
+
+      // Look the transforms up in a shuffled order
+      uint64_t state = p + 1;
+      for (size_t i = size - 1; i > 0; --i) {
+        size_t j = (size_t)(bench_key(&state) % (i + 1));
+        mars_id_t temp = entities[i];
+        entities[i] = entities[j];
+        entities[j] = temp;
+      }
+      size_t found = 0;
+      bench_start(&timers[2], &counter);
+      for (size_t i = 0; i < size; ++i) {
+        found += (engine_get_entity_component(engine, system_id, entities[i]) != NULL);
+      }
+      bench_stop(&timers[2], &counter, size);
+      mismatches += (found != size);
+
+      // Full ticks, smaller counts repeat over more passes
+      size_t ticks = 10;
+      bench_start(&timers[3], &counter);
+      for (size_t t = 0; t < ticks; ++t) {
+        engine_step(engine);
+      }
+      bench_stop(&timers[3], &counter, size * ticks);
+      if (config->threads > 0 && engine_set_threads(engine, config->threads) == 0 && system_set_parallel(system, 16384, 0) == 0) {
+        bench_start(&timers[4], &counter);
+        for (size_t t = 0; t < ticks; ++t) {
+          engine_step(engine);
+        }
+        bench_stop(&timers[4], &counter, size * ticks);
+      }
+      engine_destroy(engine);
+    }
+    bench_print("entity create", size, &timers[0]);
+    bench_print("component add", size, &timers[1]);
+    bench_print("component lookup", size, &timers[2]);
+    bench_print("tick", size, &timers[3]);
+    if (timers[4].ops > 0) { bench_print("tick parallel", size, &timers[4]); }
+    if (mismatches > 0) { printf("  (lookup mismatch!)\n"); }
+  }
+  free(entities);
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+ *  bench_entity.c
+ *  Measures spawning a wave of entities with two components one call at a time
+ *  against a single bulk spawn, and despawning entities that hold two components
+ *  out of many registered systems: probing every system per entity, destroying one
+ *  entity at a time through its signature, and destroying the whole batch in one call.
+ */
+#include "bench.h"
+
+#define BENCH_ENTITY_SYSTEMS 32
+
+static size_t bench_entity_destroys = 0;
+
+// Destroy function shared by every system
+static uint8_t bench_entity_destroy(size_t num, void** args) {
+  bench_entity_destroys++;
+  return 0;
+}
+
+// Build an engine with many systems where each entity holds a component of two of them
+static Engine* bench_entity_engine(size_t count, uint8_t storage, mars_id_t* systems, mars_id_t* entities) {
+  Engine* engine = engine_create(NULL, NULL, 0, NULL);
+  if (!engine) { return NULL; }
+  for (size_t s = 0; s < BENCH_ENTITY_SYSTEMS; ++s) {
+    systems[s] = engine_new_system(engine, sizeof(float) * 4, NULL, NULL, bench_entity_destroy);
+    engine_set_system_storage(engine, systems[s], storage);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    entities[i] = engine_new_entity(engine);
+    engine_new_entity_component(engine, systems[i % BENCH_ENTITY_SYSTEMS], entities[i]);
+    engine_new_entity_component(engine, systems[(i * 7 + 3) % BENCH_ENTITY_SYSTEMS], entities[i]);
+  }
+  return engine;
+}
+
+void bench_entity_destroy_batch(BenchConfig* config) {
+  const char* modes[] = { "probe", "single", "batch" };
+  size_t count = config->count;
+  printf("\n[entity destroy] %zu entities, 2 of %d systems each\n", count, BENCH_ENTITY_SYSTEMS);
+
+  mars_id_t* entities = malloc(sizeof(mars_id_t) * count);
+  if (!entities) { return; }
+  mars_id_t systems[BENCH_ENTITY_SYSTEMS];
+  for (uint8_t storage = MARS_STORAGE_SPARSE; storage <= MARS_STORAGE_ARCHETYPE; ++storage) {
+    for (size_t m = 0; m < 3; ++m) {
+      Engine* engine = bench_entity_engine(count, storage, systems, entities);
+      if (!engine) { break; }
+
+      // Probe: what callers did before entities tracked their components
+      bench_entity_destroys = 0;
+      double start = bench_now();
+      if (m == 0) {
+        for (size_t i = 0; i < count; ++i) {
+          for (size_t s = 0; s < BENCH_ENTITY_SYSTEMS; ++s) {
+            engine_remove_entity_component(engine, systems[s], entities[i]);
+          }
+          engine_destroy_entity(engine, entities[i]);
+        }
+      }
+      else if (m == 1) {
+        for (size_t i = 0; i < count; ++i) {
+          engine_destroy_entity(engine, entities[i]);
+        }
+      }
+      else {
+        engine_destroy_entities(engine, entities, count);
+      }
+      double elapsed = bench_now() - start;
+      printf("  %-9s %-6s %8.2f ns/entity%s\n", (storage == MARS_STORAGE_SPARSE) ? "sparse" : "archetype", modes[m], elapsed * 1e9 / (double)count,
+        (bench_entity_destroys == count * 2 && engine->entities->length == 0) ? "" : "  (destroy mismatch!)");
+      engine_destroy(engine);
+    }
+  }
+  free(entities);
+}
+
+
+void bench_entity_spawn(BenchConfig* config) {
+  const char* modes[] = { "single", "bulk" };
+  size_t count = config->count;
+  size_t waves = (config->iterations + 9) / 10;
+  printf("\n[entity spawn] %zu entities per wave, %zu waves, transform + velocity\n", count, waves);
+
+  mars_id_t* entities = malloc(sizeof(mars_id_t) * count);
+  if (!entities) { return; }
+  ComponentTransform transform = { ID_NULL, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+  float velocity[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+  for (uint8_t storage = MARS_STORAGE_SPARSE; storage <= MARS_STORAGE_ARCHETYPE; ++storage) {
+    for (size_t m = 0; m < 2; ++m) {
+      Engine* engine = engine_create(NULL, NULL, 0, NULL);
+      if (!engine) { break; }
+      mars_id_t systems[2];
+      void* prototypes[2] = { &transform, velocity };
+      systems[0] = engine_new_system(engine, sizeof(ComponentTransform), NULL, NULL, NULL);
+      systems[1] = engine_new_system(engine, sizeof(velocity), NULL, NULL, NULL);
+      engine_set_system_storage(engine, systems[0], storage);
+      engine_set_system_storage(engine, systems[1], storage);
+
+      // Spawn then clear each wave, the first wave also pays for growing the tables
+      double elapsed = 0.0;
+      for (size_t w = 0; w < waves; ++w) {
+        double start = bench_now();
+        if (m == 0) {
+          for (size_t i = 0; i < count; ++i) {
+            entities[i] = engine_new_entity(engine);
+            engine_add_entity_component(engine, systems[0], entities[i], &transform);
+            engine_add_entity_component(engine, systems[1], entities[i], velocity);
+          }
+        }
+        else {
+          engine_spawn_entities(engine, entities, count, systems, prototypes, 2);
+        }
+        elapsed += bench_now() - start;
+        engine_destroy_entities(engine, entities, count);
+      }
+      printf("  %-9s %-6s %8.2f ns/entity\n", (storage == MARS_STORAGE_SPARSE) ? "sparse" : "archetype", modes[m], elapsed * 1e9 / (double)(count * waves));
+      engine_destroy(engine);
+    }
+  }
+  free(entities);
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+/*
+ *  bench_transform.c
+ *  Measures transform integration throughput for the AoS batch update (on one
+ *  thread and across a pool) and for every SoA kernel the CPU supports, and
+ *  checks each kernel against scalar code.
+ */
+#include "bench.h"
+
+// Fill storage with the same pseudo-random state every run
+static void bench_transform_fill(ComponentTransformSoA* soa, size_t count) {
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < count; ++i) {
+    size_t index = component_transform_soa_add(soa, (mars_id_t)i);
+    seed = seed * 1664525u + 1013904223u;
+    soa->x[index] = (float)(seed >> 8) / 65536.0f;
+    soa->y[index] = (float)(seed & 0xFFFF) / 256.0f;
+    soa->l_x[index] = soa->x[index] - 0.5f;
+    soa->l_y[index] = soa->y[index] + 0.25f;
+    soa->acc[index] = (float)(seed >> 24) / 16.0f;
+  }
+}
+
+// Compare every field of two storages bit for bit
+static bool bench_transform_equal(ComponentTransformSoA* a, ComponentTransformSoA* b) {
+  size_t bytes = sizeof(float) * a->length;
+  return memcmp(a->x, b->x, bytes) == 0 && memcmp(a->y, b->y, bytes) == 0 &&
+         memcmp(a->l_x, b->l_x, bytes) == 0 && memcmp(a->l_y, b->l_y, bytes) == 0;
+}
+
+void bench_transform(BenchConfig* config) {
+  const float dt = 1.0f / 60.0f;
+  uint8_t support = mars_simd_support();
+  uint8_t selected = component_transform_get_simd();
+  printf("\n[transform] %zu entities, %zu ticks\n", config->count, config->iterations);
+
+  // AoS batch update through a System
+  System* system = system_create(sizeof(ComponentTransform), component_transform_init, NULL, NULL);
+  if (system) {
+    system->update_batch = component_transform_update_batch;
+    for (size_t i = 0; i < config->count; ++i) {
+      system_new_component(system, (mars_id_t)i);
+    }
+    float step = dt;
+    double start = bench_now();
+    for (size_t i = 0; i < config->iterations; ++i) {
+      system_update(system, &step);
+    }
+    double elapsed = bench_now() - start;
+    printf("  %-12s %10.2f M entities/s\n", "aos batch", (config->count * config->iterations) / elapsed / 1e6);
+
+    // Same update split across a pool
+    ThreadPool* pool = (config->threads > 0) ? thread_pool_create(config->threads) : NULL;
+    if (pool) {
+      system_set_parallel(system, 16384, 0);
+      start = bench_now();
+      for (size_t i = 0; i < config->iterations; ++i) {
+        system_update_parallel(system, &step, pool);
+      }
+      elapsed = bench_now() - start;
+      printf("  aos x%-7zu %10.2f M entities/s\n", pool->thread_count + 1, (config->count * config->iterations) / elapsed / 1e6);
+      thread_pool_destroy(pool);
+    }
+    system_destroy(system);
+  }
+
+  // Scalar reference result
+  ComponentTransformSoA* reference = component_transform_soa_create(config->count);
+  if (!reference) { return; }
+  bench_transform_fill(reference, config->count);
+  component_transform_set_simd(MARS_SIMD_NONE);
+  for (size_t i = 0; i < config->iterations; ++i) {
+    component_transform_soa_update(reference, dt);
+  }
+
+  // SoA kernels
+  const struct { const char* name; uint8_t simd; } kernels[] = {
+    { "soa scalar", MARS_SIMD_NONE },
+    { "soa sse2", MARS_SIMD_SSE2 },
+    { "soa avx2", MARS_SIMD_AVX2 },
+    { "soa avx2+fma", MARS_SIMD_AVX2 | MARS_SIMD_FMA },
+  };
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+    if ((kernels[k].simd & support) != kernels[k].simd) {
+      printf("  %-12s %10s\n", kernels[k].name, "n/a");
+      continue;
+    }
+    if (component_transform_set_simd(kernels[k].simd) > 0 || component_transform_get_simd() != kernels[k].simd) {
+      printf("  %-12s %10s\n", kernels[k].name, "disabled");
+      continue;
+    }
+    ComponentTransformSoA* soa = component_transform_soa_create(config->count);
+    if (!soa) { break; }
+    bench_transform_fill(soa, config->count);
+    double start = bench_now();
+    for (size_t i = 0; i < config->iterations; ++i) {
+      component_transform_soa_update(soa, dt);
+    }
+    double elapsed = bench_now() - start;
+    printf("  %-12s %10.2f M entities/s  %s\n", kernels[k].name, (config->count * config->iterations) / elapsed / 1e6,
+      bench_transform_equal(soa, reference) ? "bit-identical" : "differs from scalar");
+    component_transform_soa_destroy(soa);
+  }
+
+  // Restore kernel selection
+  component_transform_set_simd(selected);
+  component_transform_soa_destroy(reference);
+}
\ No newline at end of file
@@ -0,0 +1,150 @@
+/*
+ *  bench_umap.c
+ *  Measures unordered_map hit and miss lookup latency at several load factors, per
+ *  hash function, and table memory under steady insert/delete churn.
+ */
+#include "bench.h"
+
+// Time one lookup pass over the given keys, returns ns per lookup
+static double bench_umap_find(unordered_map* umap, mars_id_t* keys, size_t count, size_t iterations, size_t* found) {
+  *found = 0;
+  double start = bench_now();
+  for (size_t i = 0; i < iterations; ++i) {
+    for (size_t k = 0; k < count; ++k) {
+      *found += (unordered_map_find(umap, keys[k]) != NULL);
+    }
+  }
+  return (bench_now() - start) * 1e9 / (double)(count * iterations);
+}
+
+void bench_umap_lookup(BenchConfig* config) {
+  const float loads[] = { 0.25f, 0.5f, 0.75f, 0.85f };
+
+  // Round the table size up to a power of two
+  size_t capacity = 1024;
+  while (capacity < config->count) { capacity *= 2; }
+  size_t iterations = (config->iterations + 9) / 10;
+  printf("\n[umap lookup] capacity %zu, %zu passes\n", capacity, iterations);
+
+  mars_id_t* hits = malloc(sizeof(mars_id_t) * capacity);
+  mars_id_t* misses = malloc(sizeof(mars_id_t) * capacity);
+  if (!hits || !misses) {
+    free(hits);
+    free(misses);
+    return;
+  }
+  for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); ++l) {
+    // Fill to the target load without growing
+    unordered_map* umap = __umap_factory(sizeof(mars_id_t), capacity, NULL);
+    if (!umap) { break; }
+    size_t count = (size_t)(capacity * loads[l]);
+    uint64_t state = 1;
+    for (size_t i = 0; i < count; ++i) {
+      hits[i] = (mars_id_t)bench_key(&state);
+      unordered_map_insert(umap, hits[i], &hits[i]);
+      misses[i] = (mars_id_t)bench_key(&state);
+    }
+
+    // Look up keys in a shuffled order
+    for (size_t i = count - 1; i > 0; --i) {
+      size_t j = (size_t)(bench_key(&state) % (i + 1));
+      mars_id_t temp = hits[i];
+      hits[i] = hits[j];
+      hits[j] = temp;
+    }
+    size_t found_hits, found_misses;
+    double hit_ns = bench_umap_find(umap, hits, count, iterations, &found_hits);
+    double miss_ns = bench_umap_find(umap, misses, count, iterations, &found_misses);
+    printf("  load %.2f  hit %7.2f ns  miss %7.2f ns%s\n", loads[l], hit_ns, miss_ns,
+      (found_hits == count * iterations && found_misses == 0) ? "" : "  (lookup mismatch!)");
+    unordered_map_destroy(umap);
+  }
+  free(hits);
+  free(misses);
+}
+
+void bench_umap_hash(BenchConfig* config) {
+  const struct { const char* name; __umap_hash_fn hash; uint8_t random_only; } hashes[] = {
+    { "mix", __umap_hash, 0 },
+    { "fnv", __umap_hash_fnv, 0 },
+    { "fib", __umap_hash_fib, 0 },
+    { "identity", __umap_hash_identity, 1 },  // Sequential keys pile onto the same groups
+  };
+
+  // Same table size as the lookup bench, filled to 0.75 load
+  size_t capacity = 1024;
+  while (capacity < config->count) { capacity *= 2; }
+  size_t count = (size_t)(capacity * 0.75f);
+  size_t iterations = (config->iterations + 9) / 10;
+  printf("\n[umap hash] capacity %zu, load 0.75, %zu passes\n", capacity, iterations);
+
+  mars_id_t* hits = malloc(sizeof(mars_id_t) * count);
+  mars_id_t* misses = malloc(sizeof(mars_id_t) * count);
+  if (!hits || !misses) {
+    free(hits);
+    free(misses);
+    return;
+  }
+  for (uint8_t sequential = 0; sequential < 2; ++sequential) {
+    for (size_t h = 0; h < sizeof(hashes) / sizeof(hashes[0]); ++h) {
+      if (sequential && hashes[h].random_only) { continue; }
+      unordered_map* umap = __umap_factory(sizeof(mars_id_t), capacity, NULL);
+      if (!umap) { break; }
+      unordered_map_set_hash(umap, hashes[h].hash);
+
+      // Random ids, or dense ids with the misses just past the end
+      uint64_t state = 1;
+      for (size_t i = 0; i < count; ++i) {
+        hits[i] = (sequential) ? (mars_id_t)(i + 1) : (mars_id_t)bench_key(&state);
+        misses[i] = (sequential) ? (mars_id_t)(count + i + 1) : (mars_id_t)bench_key(&state);
+        unordered_map_insert(umap, hits[i], &hits[i]);
+      }
+      size_t found_hits, found_misses;
+      double hit_ns = bench_umap_find(umap, hits, count, iterations, &found_hits);
+      double miss_ns = bench_umap_find(umap, misses, count, iterations, &found_misses);
+      printf("  %-10s %-8s  hit %7.2f ns  miss %7.2f ns%s\n", sequential ? "sequential" : "random", hashes[h].name, hit_ns, miss_ns,
+        (found_hits == count * iterations && found_misses == 0) ? "" : "  (lookup mismatch!)");
+      unordered_map_destroy(umap);
+    }
+  }
+  free(hits);
+  free(misses);
+}
+
+void bench_umap_churn(BenchConfig* config) {
+  // Keep a fixed number of live keys, replacing a random one every step
+  size_t live = config->count / 4 > 0 ? config->count / 4 : 1;
+  size_t steps = live * ((config->iterations + 9) / 10);
+  printf("\n[umap churn] %zu live keys, %zu replacements\n", live, steps);
+
+  mars_id_t* keys = malloc(sizeof(mars_id_t) * live);
+  unordered_map* umap = unordered_map_create(mars_id_t);
+  if (!keys || !umap) {
+    free(keys);
+    unordered_map_destroy(umap);
+    return;
+  }
+  uint64_t state = 3;
+  for (size_t i = 0; i < live; ++i) {
+    keys[i] = (mars_id_t)bench_key(&state);
+    unordered_map_insert(umap, keys[i], &keys[i]);
+  }
+
+  // Report table memory at regular checkpoints
+  size_t checkpoint = steps / 8 > 0 ? steps / 8 : 1;
+  double start = bench_now();
+  for (size_t i = 0; i < steps; ++i) {
+    size_t slot = (size_t)(bench_key(&state) % live);
+    unordered_map_delete(umap, keys[slot]);
+    keys[slot] = (mars_id_t)bench_key(&state);
+    unordered_map_insert(umap, keys[slot], &keys[slot]);
+    if ((i + 1) % checkpoint == 0) {
+      size_t bytes = umap->__node_offset + (umap->__node_size * umap->__capacity);
+      printf("  step %10zu  length %9zu  capacity %10zu  %8.2f MB\n", i + 1, umap->length, umap->__capacity, bytes / (1024.0 * 1024.0));
+    }
+  }
+  double elapsed = bench_now() - start;
+  printf("  %.2f ns per delete+insert\n", elapsed * 1e9 / (double)steps);
+  free(keys);
+  unordered_map_destroy(umap);
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+/*
+ *  main.c
+ *  Runs the mars benchmarks with a fixed element count and iteration count, so runs
+ *  are comparable between releases. -b runs only the benchmarks whose name contains
+ *  the given text.
+ *  Usage: mars_bench [-n count] [-i iterations] [-t threads] [-b name]
+ */
+#include "bench.h"
+
+int main(int argc, char* argv[]) {
+  BenchConfig config = { 1000000, 100, 4 };
+  const char* filter = NULL;
+  const struct { const char* name; void (*run)(BenchConfig*); } benches[] = {
+    { "transform", bench_transform },
+    { "archetype", bench_archetype },
+    { "entity_spawn", bench_entity_spawn },
+    { "entity_destroy", bench_entity_destroy_batch },
+    { "umap_lookup", bench_umap_lookup },
+    { "umap_hash", bench_umap_hash },
+    { "umap_churn", bench_umap_churn },
+    { "umap_ops", bench_containers_umap },
+    { "sequence_ops", bench_containers_sequence },
+    { "engine_ops", bench_engine_ops },
+  };
+
+  // Process command line flags
+  for (int optind = 1; optind < (argc - 1) && argv[optind][0] == '-'; optind += 2) {
+    switch (argv[optind][1]) {
+      case 'n': config.count = (size_t)strtoull(argv[optind + 1], NULL, 10); break;
+      case 'i': config.iterations = (size_t)strtoull(argv[optind + 1], NULL, 10); break;
+      case 't': config.threads = (size_t)strtoull(argv[optind + 1], NULL, 10); break;
+      case 'b': filter = argv[optind + 1]; break;
+    }
+  }
+  if (config.count == 0 || config.iterations == 0) {
+    printf("Usage: mars_bench [-n count] [-i iterations] [-t threads] [-b name]\n");
+    return 1;
+  }
+
+  // Run benchmarks
+  printf("mars_bench: n=%zu iterations=%zu threads=%zu\n", config.count, config.iterations, config.threads);
+  for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b) {
+    if (!filter || strstr(benches[b].name, filter)) {
+      benches[b].run(&config);
+    }
+  }
+  return 0;
+}
\ No newline at end of file
@@ -6,12 +6,12 @@
 #include <time.h>
 
 Engine* game = NULL;
-id_t systemTransformId;
-id_t systemStepId;
+mars_id_t systemTransformId;
+mars_id_t systemStepId;
 
 uint8_t myentity_step(size_t num, void** args) {
   // Decode arguments
-  id_t entity_id = *(id_t*)args[0];
+  mars_id_t entity_id = *(mars_id_t*)args[0];
   float dt = *(float*)args[1];
 
   // Get position
@@ -50,12 +50,25 @@ uint8_t myengine_init(size_t num, void** args) {
   if (systemTransformId == ID_NULL) {
     mars_dlog(MARS_VERB_ERROR, "Failed to create transform system!\n");
   }
+  else {
+    // Integrate every transform in a single call per tick
+    engine_get_system(engine, systemTransformId)->update_batch = component_transform_update_batch;
+  }
   if (systemStepId == ID_NULL) {
     mars_dlog(MARS_VERB_ERROR, "Failed to create step system!\n");
   }
+  else {
+    // Step events read transforms, so they must not run alongside the transform system
+    system_add_read(engine_get_system(engine, systemStepId), systemTransformId);
+  }
+
+  // Keep each entity's transform & step side by side, so the step event's transform
+  // lookup is a direct index instead of a search
+  engine_set_system_storage(engine, systemTransformId, MARS_STORAGE_ARCHETYPE);
+  engine_set_system_storage(engine, systemStepId, MARS_STORAGE_ARCHETYPE);
 
   // Create entity
-  id_t entityId = engine_new_entity(engine);
+  mars_id_t entityId = engine_new_entity(engine);
   if (entityId == ID_NULL) {
     mars_dlog(MARS_VERB_ERROR, "Failed to create Entity!\n");
   }
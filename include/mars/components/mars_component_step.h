@@ -12,7 +12,7 @@
 /* Gives an entity a function call every game cycle      */
 /*=======================================================*/
 typedef struct {
-  id_t entity_id;       // Entity this component is bound to
+  mars_id_t entity_id;  // Entity this component is bound to
 	fptr_t event;         // Function to execute
 } ComponentStep;
 
@@ -12,7 +12,7 @@
 /* Gives an entity position and movement                 */
 /*=======================================================*/
 typedef struct {
-  id_t entity_id;       // Entity this component is bound to
+  mars_id_t entity_id;  // Entity this component is bound to
 	float x, y;						// Current position
 	float l_x, l_y;				// Previous position
 	float acc;						// Acceleration
@@ -21,7 +21,56 @@ typedef struct {
 // Initialize component
 MARS_API uint8_t component_transform_init(size_t, void**);
 
-// Update all instances of this component
+// Update a single instance of this component
 MARS_API uint8_t component_transform_update(size_t, void**);
 
+// Update a packed array of this component in one call
+MARS_API uint8_t component_transform_update_batch(size_t, void**);
+
+/*=======================================================*/
+/* Transform Storage (SoA)                               */
+/* Structure-of-arrays transform storage for particle    */
+/* heavy scenes. Each field is a 32-byte aligned array   */
+/* so the integration kernel can use SSE2/AVX2.          */
+/*=======================================================*/
+typedef struct {
+  size_t length;          // Number of stored transforms
+  size_t capacity;        // Number of transforms that fit before resizing
+  vector* sparse;         // Array index of each entity, indexed by entity_index()
+  mars_id_t* entity_id;   // Entity each index is bound to
+  float* x;               // Current position
+  float* y;
+  float* l_x;             // Previous position
+  float* l_y;
+  float* acc;             // Acceleration
+  void* __block;          // Allocation backing every array
+} ComponentTransformSoA;
+
+// Create empty SoA transform storage
+MARS_API ComponentTransformSoA* component_transform_soa_create(size_t);
+
+// Add a zeroed transform for the entity and return its index (SIZE_MAX on failure)
+MARS_API size_t component_transform_soa_add(ComponentTransformSoA*, mars_id_t);
+
+// Get the index of the entity's transform (SIZE_MAX if not found)
+MARS_API size_t component_transform_soa_find(ComponentTransformSoA*, mars_id_t);
+
+// Remove the entity's transform, moving the last transform into its index
+MARS_API uint8_t component_transform_soa_remove(ComponentTransformSoA*, mars_id_t);
+
+// Integrate every transform using the selected instruction set
+MARS_API void component_transform_soa_update(ComponentTransformSoA*, float);
+
+// Free the storage
+MARS_API void component_transform_soa_destroy(ComponentTransformSoA*);
+
+// Select the instruction set for the SoA kernel (MARS_SIMD_* flags), returns 1 if unsupported.
+// Defaults to the best set reported by mars_simd_support(). FMA is only used when
+// MARS_DETERMINISTIC is not defined, so every kernel matches the scalar path bit for bit
+// in deterministic builds.
+MARS_API uint8_t component_transform_set_simd(uint8_t);
+
+// Get the instruction set used by the SoA kernel
+MARS_API uint8_t component_transform_get_simd();
+
 #endif  // MARS_COMPONENT_TRANSFORM_H
\ No newline at end of file
@@ -0,0 +1,57 @@
+/*
+ * allocator.h
+ * Memory interface the containers allocate through. A NULL allocator means malloc & free.
+ */
+
+#ifndef C_ALLOCATOR_H
+#define C_ALLOCATOR_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define allocator_alloc(a, s) __allocator_alloc(a, s)
+#define allocator_realloc(a, p, o, s) __allocator_realloc(a, p, o, s)
+#define allocator_free(a, p, s) __allocator_free(a, p, s)
+
+// Sizes are passed back on realloc & free, so implementations don't need to store them
+typedef struct {
+  void* (*alloc)(void*, size_t);                  // {user, size}
+  void* (*realloc)(void*, void*, size_t, size_t); // {user, pointer, old size, new size}
+  void (*free)(void*, void*, size_t);             // {user, pointer, size}
+  void* user;                                     // Passed to every function
+} allocator;
+
+static inline void* __allocator_alloc(allocator* a, size_t size) {
+  return (a) ? a->alloc(a->user, size) : malloc(size);
+}
+
+static inline void* __allocator_realloc(allocator* a, void* ptr, size_t old_size, size_t new_size) {
+  return (a) ? a->realloc(a->user, ptr, old_size, new_size) : realloc(ptr, new_size);
+}
+
+static inline void __allocator_free(allocator* a, void* ptr, size_t size) {
+  if (!ptr) { return; }
+  if (a) { a->free(a->user, ptr, size); }
+  else { free(ptr); }
+}
+
+// Memory held by one container or summed over many, each container's *_stats macro adds
+// its own figures to a running total
+typedef struct {
+  size_t bytes;     // Bytes held now
+  size_t peak;      // Most bytes ever held (a sum of each container's peak once totalled)
+  size_t allocs;    // Allocations made, one on creation & one per resize
+  size_t resizes;   // Times the storage grew or shrank
+} container_stats;
+
+#define __container_peak(p, b) ((p) = ((b) > (p)) ? (b) : (p))
+
+static inline void __container_stats_add(container_stats* stats, size_t bytes, size_t peak, size_t resizes) {
+  stats->bytes += bytes;
+  stats->peak += (peak > bytes) ? peak : bytes;
+  stats->allocs += resizes + 1;
+  stats->resizes += resizes;
+}
+
+#endif  // C_ALLOCATOR_H
\ No newline at end of file
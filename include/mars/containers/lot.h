@@ -7,10 +7,12 @@
 #define C_LOT_H
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include "allocator.h"
 
-#ifdef __LOT_32  // 32 bit keys
+#if defined(__LOT_32) || defined(MARS_32)  // 32 bit keys
 typedef uint32_t __lot_key_t;
 typedef uint16_t __lot_index_t;
 #else // 64 bit keys
@@ -19,6 +21,7 @@ typedef uint32_t __lot_index_t;
 #endif
 
 #define __LOT_DEFAULT_CAPACITY 32
+#define __LOT_MAX_CAPACITY ((size_t)(__lot_index_t)-1)  // Most slots a key's index can address
 
 #define __lot_stack_head(l) (__lot_index_t*)(&(l)->__buffer[0] + (sizeof(__lot_index_t) * (l)->__stack_head))
 #define __lot_stack_push(l, n) memcpy(__lot_stack_head(l), &n, sizeof(__lot_index_t)); (l)->__stack_head++
@@ -29,31 +32,47 @@ typedef uint32_t __lot_index_t;
 #define __lot_node_data(l, i) (void*)(__lot_node(l, i) + (l)->__element_size)
 #define __lot_key(c, i) ((__lot_key_t)(c) << (sizeof(__lot_index_t) * 8)) | ((__lot_key_t)0 | i)
 #define __lot_key_count(k) (uint8_t)(k >> (sizeof(__lot_index_t) * 8)) & 0x7F
+#define __lot_bytes(e, c) (offsetof(lot, __buffer) + (sizeof(__lot_key_t) * (c)) + (__lot_node_size(e) * (c)))
 #define __lot_key_index(k) (__lot_index_t)(k & (((__lot_key_t)1 << (sizeof(__lot_index_t) * 8)) - 1))
 
-#define lot_create(t) __lot_factory(sizeof(t), __LOT_DEFAULT_CAPACITY)
-#define lot_destroy(l) free(l)
+#define lot_create(t) __lot_factory(sizeof(t), __LOT_DEFAULT_CAPACITY, NULL)
+#define lot_create_alloc(t, a) __lot_factory(sizeof(t), __LOT_DEFAULT_CAPACITY, a)
+#define lot_destroy(l) __lot_destroy(l)
+#define lot_bytes(l) __lot_bytes((l)->__element_size, (l)->__capacity)
+#define lot_stats(l, s) __container_stats_add(s, lot_bytes(l), (l)->__peak, (l)->__resizes)
 #define lot_insert(l, k, d) __lot_insert(&l, (__lot_key_t*)k, (void*)d)
 #define lot_find(l, k) __lot_find(l, k)
 #define lot_delete(l, k) __lot_delete(l, k)
+#define lot_reserve(l, n) __lot_reserve(&l, n)
+#define lot_shrink_to_fit(l) __lot_shrink(&l)
 #define lot_it(l) __lot_it(l)
 #define lot_it_next(i) __lot_next(&i)
+#define lot_iter_init(l, i) __lot_iter_init(l, i)
+#define lot_iter_next(i) __lot_iter_next(i)
+#define lot_iter_done(i) ((i)->data == NULL)
+#define lot_foreach(l, i) for (lot_it_t i = __lot_iter_begin(l); !lot_iter_done(&i); __lot_iter_next(&i))
 
 typedef struct {
   size_t length;
   size_t __capacity;
   size_t __element_size;
   size_t __stack_head;
+  size_t __peak;
+  size_t __resizes;
+  allocator* __allocator;
   uint8_t __buffer[];
 } lot;
 
 typedef struct {
   lot* __lot;
   void* data;
+  __lot_key_t key;
   size_t __index;
 } lot_it_t;
 
-lot* __lot_factory(size_t, size_t);
+lot* __lot_factory(size_t, size_t, allocator*);
+
+void __lot_destroy(lot*);
 
 lot* __lot_resize(lot*, size_t);
 
@@ -63,6 +82,16 @@ void* __lot_find(lot*, __lot_key_t);
 
 uint8_t __lot_delete(lot*, __lot_key_t);
 
+uint8_t __lot_reserve(lot**, size_t);
+
+uint8_t __lot_shrink(lot**);
+
+void __lot_iter_init(lot*, lot_it_t*);
+
+lot_it_t __lot_iter_begin(lot*);
+
+void __lot_iter_next(lot_it_t*);
+
 lot_it_t* __lot_it(lot*);
 
 void __lot_next(lot_it_t**);
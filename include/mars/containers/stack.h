@@ -7,28 +7,40 @@
 #define C_STACK_H
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include "allocator.h"
 
 #define __STACK_DEFAULT_CAPACITY 8
 
-#define stack_create(t) __stack_factory(sizeof(t), __STACK_DEFAULT_CAPACITY)
-#define stack_destroy(s) free(s)
+#define stack_create(t) __stack_factory(sizeof(t), __STACK_DEFAULT_CAPACITY, NULL)
+#define stack_create_alloc(t, a) __stack_factory(sizeof(t), __STACK_DEFAULT_CAPACITY, a)
+#define stack_destroy(s) __stack_destroy(s)
 #define stack_head(s, t) *(t*)((s)->length > 0 ? (&(s)->__buffer[0] + ((s)->length - 1) * (s)->__element_size) : NULL)
 #define stack_push(s, d) __stack_insert(&s, (void*)d)
 #define stack_pop(s) __stack_remove(s, 1)
 #define stack_clear(s) __stack_remove(s, (s)->length)
+#define stack_reserve(s, n) __stack_reserve(&s, n)
+#define stack_shrink_to_fit(s) __stack_shrink(&s)
 #define stack_max_length(s) 4294967295UL / ((s)->__element_size - 1)
-#define stack_bytes(s) offsetof(stack, __buffer) + ((s)->__element_size * (s)->__capacity)
+#define stack_foreach(s, t, p) for (t* p = (t*)((s)->__buffer); p < (t*)((s)->__buffer) + (s)->length; ++p)
+#define stack_bytes(s) (offsetof(stack, __buffer) + ((s)->__element_size * (s)->__capacity))
+#define stack_stats(s, t) __container_stats_add(t, stack_bytes(s), (s)->__peak, (s)->__resizes)
 
 typedef struct {
   size_t length;
   size_t __capacity;
   size_t __element_size;
+  size_t __peak;
+  size_t __resizes;
+  allocator* __allocator;
   uint8_t __buffer[];
 } stack;
 
-stack* __stack_factory(size_t, size_t);
+stack* __stack_factory(size_t, size_t, allocator*);
+
+void __stack_destroy(stack*);
 
 stack* __stack_resize(stack*, size_t);
 
@@ -36,4 +48,8 @@ uint8_t __stack_insert(stack**, void*);
 
 uint8_t __stack_remove(stack*, size_t);
 
+uint8_t __stack_reserve(stack**, size_t);
+
+uint8_t __stack_shrink(stack**);
+
 #endif  //C_STACK_H
\ No newline at end of file
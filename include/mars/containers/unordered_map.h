@@ -8,53 +8,91 @@
 #define C_UMAP_H
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include "allocator.h"
 
-#ifdef __UMAP_32  // 32 bit hash
+#if defined(__UMAP_32) || defined(MARS_32)  // 32 bit hash
 typedef uint32_t __umap_key_t;
 typedef uint32_t __umap_hash_t;
 #define __fnv_offset 2166136261U;
 #define __fnv_prime 16777619U;
+#define __fib_multiplier 0x9E3779B9U
 #else // 64 bit hash
 typedef uint64_t __umap_key_t;
 typedef uint64_t __umap_hash_t;
 #define __fnv_offset 14695981039346656037UL;
 #define __fnv_prime 1099511628211UL;
+#define __fib_multiplier 0x9E3779B97F4A7C15ULL
+#endif
+
+// Control bytes are probed a group at a time: 16 with SSE2, otherwise 8 using 64-bit SWAR
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define __UMAP_SSE2
+#define __UMAP_GROUP_WIDTH 16
+#else
+#define __UMAP_GROUP_WIDTH 8
 #endif
 
 #define __UMAP_DEFAULT_CAPACITY 32
+#define __UMAP_MIN_CAPACITY __UMAP_GROUP_WIDTH
 #define __UMAP_DEFAULT_LOAD 0.875f
+#define __UMAP_NODE_ALIGN 8   // Alignment of every node & its data
+#define __UMAP_NODE_DATA ((sizeof(__umap_key_t) + (__UMAP_NODE_ALIGN - 1)) & ~(__UMAP_NODE_ALIGN - 1))
 #define __UMAP_EMPTY 0x80     // 0b1000 0000
 #define __UMAP_DELETED 0xFE   // 0b1111 1110
 #define __UMAP_SENTINEL 0xFF  // 0b1111 1111
 
 #define __align_to(x, y) (x + (y - 1)) & ~(y - 1)
-#define __umap_h1(h) h >> 7
-#define __umap_h2(h) h & 0x7F
-#define __umap_ctrl(u, i) (uint8_t*)(&(u)->__buffer[0] + i)
-#define __umap_node(u, i) (&(u)->__buffer[0] + (u)->__capacity + (__umap_node_size((u)->__element_size) * i))
+#define __umap_h1(h) ((h) >> 7)
+#define __umap_h2(h) (uint8_t)((h) & 0x7F)
+#define __umap_ctrl(u, i) (uint8_t*)(&(u)->__buffer[0] + (i))
+#define __umap_ctrl_bytes(c) ((c) + __UMAP_GROUP_WIDTH)
+#define __umap_node(u, i) ((uint8_t*)(u) + (u)->__node_offset + ((u)->__node_size * (i)))
 #define __umap_node_key(u, i) (__umap_key_t*)__umap_node(u, i)
-#define __umap_node_data(u, i) (void*)(__umap_node(u, i) + ((u)->__element_size > sizeof(__umap_key_t) ? (u)->__element_size : sizeof(__umap_key_t)))
+#define __umap_node_data(u, i) (void*)(__umap_node(u, i) + __UMAP_NODE_DATA)
 
-#define unordered_map_create(t) __umap_factory(sizeof(t), __UMAP_DEFAULT_CAPACITY)
-#define unordered_map_destroy(u) free(u)
+#define unordered_map_create(t) __umap_factory(sizeof(t), __UMAP_DEFAULT_CAPACITY, NULL)
+#define unordered_map_create_alloc(t, a) __umap_factory(sizeof(t), __UMAP_DEFAULT_CAPACITY, a)
+#define unordered_map_destroy(u) __umap_destroy(u)
+#define unordered_map_bytes(u) ((u)->__node_offset + ((u)->__node_size * (u)->__capacity))
+#define unordered_map_stats(u, s) __container_stats_add(s, unordered_map_bytes(u), (u)->__peak, (u)->__resizes)
 #define unordered_map_insert(u, k, d) __umap_insert(&u, k, (void*)d)
 #define unordered_map_find(u, k) __umap_find(u, k)
 #define unordered_map_delete(u, k) __umap_delete(u, k)
 #define unordered_map_set_load(u, f) { if (u) u->__load_factor = f; }
-#define unordered_map_clear(u) memset(__umap_ctrl(u, 0), __UMAP_EMPTY, (u)->__capacity)
+#define unordered_map_clear(u) __umap_clear(u)
 #define unordered_map_it(u) __umap_it(u)
 #define unordered_map_it_next(i) __umap_next(&i)
-#define unordered_map_rehash(u) { unordered_map* __umap_temp__ = __umap_resize(u, (u)->__capacity); if (__umap_temp__) u = __umap_temp__; }
-
+#define unordered_map_iter_init(u, i) __umap_iter_init(u, i)
+#define unordered_map_iter_next(i) __umap_iter_next(i)
+#define unordered_map_iter_done(i) ((i)->data == NULL)
+#define unordered_map_foreach(u, i) for (umap_it_t i = __umap_iter_begin(u); !unordered_map_iter_done(&i); __umap_iter_next(&i))
+#define unordered_map_rehash(u) __umap_rehash(u)
+#define unordered_map_set_hash(u, f) __umap_set_hash(u, f)
+#define unordered_map_reserve(u, n) __umap_reserve(&u, n)
+#define unordered_map_shrink_to_fit(u) __umap_shrink(&u)
+
+// Hash hook, every key of a map goes through the same function
+typedef __umap_hash_t (*__umap_hash_fn)(__umap_key_t);
+
+// Buffer holds __capacity control bytes, followed by __UMAP_GROUP_WIDTH mirrored copies of
+// the first control bytes (so a group load never wraps), followed by the aligned nodes.
+// Each node holds the key followed by the data.
 typedef struct {
   size_t length;
   size_t __capacity;
   size_t __element_size;
+  size_t __node_size;
+  size_t __node_offset;
   size_t __load_count;
   float __load_factor;
+  __umap_hash_fn __hash;
+  size_t __peak;
+  size_t __resizes;
+  allocator* __allocator;
   uint8_t __buffer[];
 } unordered_map;
 
@@ -67,18 +105,48 @@ typedef struct {
 
 size_t __umap_node_size(size_t);
 
-unordered_map* __umap_factory(size_t, size_t);
+unordered_map* __umap_factory(size_t, size_t, allocator*);
+
+void __umap_destroy(unordered_map*);
 
 unordered_map* __umap_resize(unordered_map*, size_t);
 
+// Default hash, murmur3 finalizer; mixes every key bit into every hash bit
 __umap_hash_t __umap_hash(__umap_key_t);
 
+// Byte-wise FNV-1a, the previous default
+__umap_hash_t __umap_hash_fnv(__umap_key_t);
+
+// Single multiply (Fibonacci hashing); good enough for sequential ids & lot keys
+__umap_hash_t __umap_hash_fib(__umap_key_t);
+
+// No mixing; only for keys that are already uniformly random in every bit
+__umap_hash_t __umap_hash_identity(__umap_key_t);
+
+void __umap_set_hash(unordered_map*, __umap_hash_fn);
+
 uint8_t __umap_insert(unordered_map**, __umap_key_t, void*);
 
 uint8_t __umap_delete(unordered_map*, __umap_key_t);
 
+void __umap_rehash(unordered_map*);
+
+// Grow once so the given number of keys fit under the load factor
+uint8_t __umap_reserve(unordered_map**, size_t);
+
+// Shrink to the smallest capacity holding the current keys, dropping tombstones
+uint8_t __umap_shrink(unordered_map**);
+
+void __umap_clear(unordered_map*);
+
 void* __umap_find(unordered_map*, __umap_key_t);
 
+void __umap_iter_init(unordered_map*, umap_it_t*);
+
+umap_it_t __umap_iter_begin(unordered_map*);
+
+void __umap_iter_next(umap_it_t*);
+
 umap_it_t* __umap_it(unordered_map*);
 
 void __umap_next(umap_it_t**);
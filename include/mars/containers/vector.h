@@ -7,31 +7,50 @@
 #define C_VECTOR_H
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include "allocator.h"
 
 #define __VECTOR_DEFAULT_CAPACITY 8
 
-#define vector_create(t) __vec_factory(sizeof(t), __VECTOR_DEFAULT_CAPACITY)
-#define vector_destroy(v) free(v)
+#define vector_create(t) __vec_factory(sizeof(t), __VECTOR_DEFAULT_CAPACITY, NULL)
+#define vector_create_size(s) __vec_factory(s, __VECTOR_DEFAULT_CAPACITY, NULL)
+#define vector_create_alloc(t, a) __vec_factory(sizeof(t), __VECTOR_DEFAULT_CAPACITY, a)
+#define vector_create_size_alloc(s, a) __vec_factory(s, __VECTOR_DEFAULT_CAPACITY, a)
+#define vector_destroy(v) __vec_destroy(v)
+#define vector_data(v) (void*)(&(v)->__buffer[0])
+#define vector_at(v, i) (void*)(&(v)->__buffer[0] + (i) * (v)->__element_size)
 #define vector_get(v, i, t) *(t*)((i < (v)->length && i >= 0) ? (&(v)->__buffer[0] + i * (v)->__element_size) : NULL)
 #define vector_set(v, i, d) { if (i < (v)->length && i >= 0) memcpy((&(v)->__buffer[0] + i * (v)->__element_size), &d, (v)->__element_size) }
 #define vector_push_back(v, d) __vec_insert(&v, (v)->length, (void*)d)
+#define vector_emplace_back(v) __vec_emplace(&v)
+#define vector_insert(v, i, d) __vec_insert(&v, i, (void*)d)
 #define vector_push_front(v, d) __vec_insert(&v, 0, (void*)d)
 #define vector_pop_back(v) __vec_remove(v, (v)->length - 1, 1)
 #define vector_pop_front(v) __vec_remove(v, 0, 1)
+#define vector_remove(v, i) __vec_remove(v, i, 1)
 #define vector_clear(v) __vec_remove(v, 0, (v)->length)
+#define vector_reserve(v, n) __vec_reserve(&v, n)
+#define vector_shrink_to_fit(v) __vec_shrink(&v)
 #define vector_max_length(v) 4294967295UL / ((v)->__element_size - 1)
-#define vector_bytes(v) offsetof(vector, __buffer) + ((v)->__element_size * (v)->__capacity)
+#define vector_foreach(v, t, p) for (t* p = (t*)vector_data(v); p < (t*)vector_data(v) + (v)->length; ++p)
+#define vector_bytes(v) (offsetof(vector, __buffer) + ((v)->__element_size * (v)->__capacity))
+#define vector_stats(v, s) __container_stats_add(s, vector_bytes(v), (v)->__peak, (v)->__resizes)
 
 typedef struct {
   size_t length;
   size_t __capacity;
   size_t __element_size;
+  size_t __peak;
+  size_t __resizes;
+  allocator* __allocator;
   uint8_t __buffer[];
 } vector;
 
-vector* __vec_factory(size_t, size_t);
+vector* __vec_factory(size_t, size_t, allocator*);
+
+void __vec_destroy(vector*);
 
 vector* __vec_resize(vector*, size_t);
 
@@ -39,5 +58,11 @@ uint8_t __vec_insert(vector**, size_t, void*);
 
 uint8_t __vec_remove(vector*, size_t, size_t);
 
+void* __vec_emplace(vector**);
+
+uint8_t __vec_reserve(vector**, size_t);
+
+uint8_t __vec_shrink(vector**);
+
 
 #endif  //C_VECTOR_H
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 // Core functionality
 #include "mars_core.h"
+#include "mars_trace.h"
 
 // Built-in components
 #include "components/mars_component_transform.h"
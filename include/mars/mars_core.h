@@ -16,14 +16,8 @@
 #include <stdarg.h>
 #include "containers/vector.h"
 #include "containers/stack.h"
-#ifdef MARS_32  // Use 32-bit hashing
-  #define __UMAP_32
-#endif
-#include "containers/unordered_map.h"
-#ifdef MARS_32  // Use 32-bit keys
-  #define __LOT_32
-#endif
-#include "containers/lot.h"
+#include "containers/unordered_map.h"   // 32-bit hashing under MARS_32
+#include "containers/lot.h"             // 32-bit keys under MARS_32
 
 
 /*=======================================================*/
@@ -46,6 +40,11 @@
 #define MARS_VERB_WARNING 0x2 // 0000 0010
 #define MARS_VERB_NOTICE 0x4  // 0000 0100
 
+#define MARS_SIMD_NONE 0x0    // Scalar code only
+#define MARS_SIMD_SSE2 0x1    // 128-bit SSE2
+#define MARS_SIMD_AVX2 0x2    // 256-bit AVX2
+#define MARS_SIMD_FMA 0x4     // Fused multiply-add (FMA3)
+
 
 /*=======================================================*/
 /* Typedefs                                              */
@@ -71,118 +70,819 @@ typedef uint8_t (*fptr_t)(size_t, void**);    // Function pointer type with list
 	#include <sys/time.h>
 #endif
 
+// Threading primitives
+#if defined(_WIN32)
+  typedef HANDLE mars_thread_t;
+  typedef SRWLOCK mars_mutex_t;
+  typedef CONDITION_VARIABLE mars_cond_t;
+#else
+  #include <pthread.h>
+  typedef pthread_t mars_thread_t;
+  typedef pthread_mutex_t mars_mutex_t;
+  typedef pthread_cond_t mars_cond_t;
+#endif
+#if defined(_MSC_VER)
+  #define MARS_THREAD_LOCAL __declspec(thread)
+#else
+  #define MARS_THREAD_LOCAL __thread
+#endif
+#if defined(_MSC_VER)
+  #define MARS_ALIGN(n) __declspec(align(n))
+#else
+  #define MARS_ALIGN(n) _Alignas(n)
+#endif
+
+// Atomically add to a counter and return the new value
+static inline size_t mars_atomic_add(volatile size_t* ptr, size_t value) {
+  #if defined(_MSC_VER) && defined(_WIN64)
+    return (size_t)InterlockedExchangeAdd64((volatile LONG64*)ptr, (LONG64)value) + value;
+  #elif defined(_MSC_VER)
+    return (size_t)InterlockedExchangeAdd((volatile LONG*)ptr, (LONG)value) + value;
+  #else
+    return __atomic_add_fetch(ptr, value, __ATOMIC_ACQ_REL);
+  #endif
+}
+
+// Atomically read a counter
+static inline size_t mars_atomic_load(volatile size_t* ptr) {
+  #if defined(_MSC_VER)
+    return *ptr;  // Volatile reads have acquire semantics under /volatile:ms
+  #else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+  #endif
+}
+
+// Atomically write a counter
+static inline void mars_atomic_store(volatile size_t* ptr, size_t value) {
+  #if defined(_MSC_VER)
+    *ptr = value;  // Volatile writes have release semantics under /volatile:ms
+  #else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+  #endif
+}
+
+// Atomically replace a value if it still holds the expected value, returns true on success
+static inline bool mars_atomic_cas(volatile size_t* ptr, size_t expected, size_t desired) {
+  #if defined(_MSC_VER) && defined(_WIN64)
+    return (size_t)InterlockedCompareExchange64((volatile LONG64*)ptr, (LONG64)desired, (LONG64)expected) == expected;
+  #elif defined(_MSC_VER)
+    return (size_t)InterlockedCompareExchange((volatile LONG*)ptr, (LONG)desired, (LONG)expected) == expected;
+  #else
+    return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  #endif
+}
+
 // Architecture specific
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  #define MARS_X86
+#endif
 #ifdef MARS_32
-  typedef uint32_t id_t;   // Use 32-bit keys for tables
+  typedef uint32_t mars_id_t;   // Use 32-bit keys for tables
   #define ID_NULL 0x80000000
+  typedef uint32_t signature_t;   // One bit per system
+  #define MARS_MAX_COMPONENTS 32
+  #define ID_PENDING 0x40000000   // Set on handles of entities waiting for a command flush
 #else
-  typedef uint64_t id_t;   // Use 64-bit keys for tables
+  typedef uint64_t mars_id_t;   // Use 64-bit keys for tables
   #define ID_NULL 0x8000000000000000
+  typedef uint64_t signature_t;   // One bit per system
+  #define MARS_MAX_COMPONENTS 64
+  #define ID_PENDING 0x4000000000000000
 #endif
 
 
 /*=======================================================*/
 /* Global functions                                      */
 /*=======================================================*/
-MARS_API id_t uuid_generate();
+MARS_API mars_id_t uuid_generate();
 
 MARS_API void mars_dlog(uint8_t, const char*, ...);
 
+// Get the SIMD instruction sets supported by the running CPU (MARS_SIMD_* flags)
+MARS_API uint8_t mars_simd_support();
+
+// Read a monotonic clock, in nanoseconds from an arbitrary starting point
+MARS_API uint64_t mars_time_ns();
+
+// Block the calling thread until the monotonic clock reaches the given time
+MARS_API void mars_sleep_until(uint64_t);
+
+// Map a whole file copy-on-write (writes stay private to the process), storing its size.
+// Returns NULL on failure.
+MARS_API void* mars_map_file(const char*, size_t*);
+
+// Release a mapping made by mars_map_file (NULL is ignored)
+MARS_API void mars_unmap_file(void*, size_t);
+
+
+/*=======================================================================================*/
+/* Thread Pool                                                                           */
+/* Worker threads that run queued jobs. Each job decrements a caller-owned pending       */
+/* counter when it finishes, and threads waiting on that counter run queued jobs while   */
+/* they wait, so jobs may safely submit and wait on more jobs.                           */
+/*                                                                                       */
+/* Parallel-for splits an index range evenly between the caller and the workers. Each    */
+/* thread takes grain-sized chunks from the front of its own range, and once it runs dry */
+/* steals the back half of another thread's range.                                       */
+/*=======================================================================================*/
+#define MARS_JOB_ARGS 4
+#define MARS_PARALLEL_SLOTS 64
+
+typedef struct {
+  fptr_t func;                  // Function to run
+  size_t num;                   // Number of arguments
+  void* args[MARS_JOB_ARGS];    // Arguments passed to the function
+  volatile size_t* pending;     // Counter decremented once the job finishes
+} ThreadJob;
+
+typedef struct {
+  mars_thread_t* threads;       // Worker threads
+  size_t thread_count;          // Number of worker threads
+  mars_mutex_t lock;            // Guards the job queue
+  mars_cond_t wake;             // Signaled when jobs are queued or the pool stops
+  vector* jobs;                 // Queued jobs
+  size_t head;                  // Index of the next queued job
+  bool run;                     // Keep the workers alive
+} ThreadPool;
+
+// Create a pool with the given number of worker threads
+MARS_API ThreadPool* thread_pool_create(size_t);
+
+// Queue a job, incrementing the pending counter
+MARS_API uint8_t thread_pool_submit(ThreadPool*, fptr_t, size_t, void**, volatile size_t*);
+
+// Run queued jobs until the pending counter reaches zero
+MARS_API void thread_pool_wait(ThreadPool*, volatile size_t*);
+
+// Call a function over [0, count) in chunks of at most grain indices, spread across the
+// pool and the calling thread. The function receives {&begin, &end, args...}.
+MARS_API void thread_pool_parallel_for(ThreadPool*, size_t, size_t, fptr_t, size_t, void**);
+
+// Stop and join all workers, then free the pool
+MARS_API void thread_pool_destroy(ThreadPool*);
+
+// Get the index of the calling thread (0 for threads outside a pool, 1..N for workers)
+MARS_API size_t mars_thread_index();
+
+
+/*=======================================================================================*/
+/* Allocator                                                                             */
+/* Implementations of the memory interface every container allocates through (see        */
+/* containers/allocator.h). Each keeps an AllocatorStats with its traffic; the heap      */
+/* allocator updates it atomically, the others must only be used from one thread at a    */
+/* time. Pass &allocator.base wherever an allocator* is taken.                           */
+/*                                                                                       */
+/* The pool hands out fixed-size blocks carved from larger slabs and keeps freed blocks  */
+/* for reuse until it is destroyed. The frame arena bumps a pointer through one block,   */
+/* frees are no-ops and everything is released at once by a reset.                       */
+/*=======================================================================================*/
+#define MARS_ALLOCATOR_ALIGN 16       // Alignment of every block handed out by the pool & arena
+
+typedef struct {
+  volatile size_t allocs;     // Blocks handed out (a realloc that moves counts as one more)
+  volatile size_t frees;      // Blocks given back
+  volatile size_t bytes;      // Bytes currently handed out
+  volatile size_t peak;       // Highest value bytes has reached
+  volatile size_t reserved;   // Bytes currently held from the parent allocator or the system
+} AllocatorStats;
+
+typedef struct {
+  allocator base;             // Interface (base.user points back at this struct)
+  AllocatorStats stats;
+} HeapAllocator;
+
+typedef struct {
+  allocator base;             // Interface (base.user points back at this struct)
+  AllocatorStats stats;
+  allocator* parent;          // Source of slabs and of requests larger than a block
+  size_t block_size;          // Size (in bytes) of each block
+  size_t slab_blocks;         // Blocks per slab
+  void* free_list;            // First free block, each free block points to the next
+  void* slabs;                // Most recent slab, each slab points to the previous
+} PoolAllocator;
+
+typedef struct {
+  allocator base;             // Interface (base.user points back at this struct)
+  AllocatorStats stats;
+  allocator* parent;          // Source of the block and of overflow allocations
+  uint8_t* block;             // Memory being bumped through
+  size_t capacity;            // Size (in bytes) of the block
+  size_t used;                // Bytes of the block handed out
+  size_t last;                // Offset of the most recent allocation in the block
+  void* overflow;             // Allocations that didn't fit, each points to the previous
+  size_t overflow_bytes;      // Total size of those allocations
+} FrameArena;
+
+// Copy the current values of an allocator's statistics
+MARS_API AllocatorStats allocator_stats_get(AllocatorStats*);
+
+// Set up an allocator forwarding to malloc, realloc & free
+MARS_API void heap_allocator_init(HeapAllocator*);
+
+// Create a pool of blocks of the given size, taking slabs of the given number of blocks
+// from the parent (NULL for malloc)
+MARS_API PoolAllocator* pool_allocator_create(allocator*, size_t, size_t);
+
+// Return every slab to the parent and free the pool, blocks still in use become invalid
+MARS_API void pool_allocator_destroy(PoolAllocator*);
+
+// Create an arena with a block of the given size taken from the parent (NULL for malloc)
+MARS_API FrameArena* frame_arena_create(allocator*, size_t);
+
+// Release everything allocated from the arena. If it overflowed since the last reset, its
+// block grows to hold everything that was allocated.
+MARS_API uint8_t frame_arena_reset(FrameArena*);
+
+// Return the block to the parent and free the arena
+MARS_API void frame_arena_destroy(FrameArena*);
+
+
+/*=======================================================================================*/
+/* Profiler                                                                              */
+/* Timing of each system's update and of each whole engine step, taken with the          */
+/* monotonic clock. Every sample is kept in a fixed ring of the most recent ticks, so    */
+/* recording costs two clock reads and a store, and percentiles are only worked out      */
+/* when asked for.                                                                       */
+/*=======================================================================================*/
+#define MARS_PROFILE_WINDOW 256       // Ticks kept for rolling statistics
+#define MARS_PROFILE_JSON 0           // Dump as one JSON object
+#define MARS_PROFILE_CSV 1            // Dump as CSV with a header row
+
+typedef struct {
+  uint64_t start;             // Monotonic time (ns) the tick started
+  uint64_t duration;          // Wall time (ns) the tick took
+  size_t count;               // Components (or entities, for engine steps) processed
+} ProfileSample;
+
+typedef struct {
+  ProfileSample samples[MARS_PROFILE_WINDOW];   // Most recent ticks, oldest overwritten first
+  size_t ticks;               // Ticks recorded, the next one goes to samples[ticks % window]
+  uint64_t total;             // Wall time (ns) of every tick recorded
+  uint64_t peak;              // Longest tick recorded
+} Profile;
+
+// Statistics over the ticks in a profile's window
+typedef struct {
+  size_t ticks;               // Ticks recorded in total
+  uint64_t last_ns;           // Wall time of the most recent tick
+  double mean_ns;             // Mean wall time
+  uint64_t p50_ns;            // Median wall time
+  uint64_t p99_ns;            // 99th percentile wall time
+  uint64_t max_ns;            // Longest wall time
+  uint64_t peak_ns;           // Longest wall time since profiling started
+  size_t components;          // Components processed by the most recent tick
+  double calls_per_sec;       // Ticks per second of real time
+} ProfileStats;
+
+// Add a tick to a profile
+static inline void profile_record(Profile* profile, uint64_t start, uint64_t end, size_t count) {
+  ProfileSample* sample = &profile->samples[profile->ticks % MARS_PROFILE_WINDOW];
+  sample->start = start;
+  sample->duration = end - start;
+  sample->count = count;
+  profile->ticks++;
+  profile->total += sample->duration;
+  profile->peak = (sample->duration > profile->peak) ? sample->duration : profile->peak;
+}
+
+// Work out the statistics of a profile
+MARS_API uint8_t profile_stats(Profile*, ProfileStats*);
+
+
+/*=======================================================================================*/
+/* Archetype                                                                             */
+/* Table holding every entity with the same set of archetype-stored components. Rows are */
+/* split into fixed-size chunks; each chunk holds the entity IDs followed by one aligned */
+/* column per component, in component bit order. Removing a row moves the last row into  */
+/* its place.                                                                            */
+/*=======================================================================================*/
+#define MARS_ARCHETYPE_CHUNK 16384  // Target size (in bytes) of each chunk
+#define MARS_ARCHETYPE_ALIGN 16     // Alignment of every column within a chunk
+#define MARS_ARCHETYPE_SLAB 8       // Chunks the engine's chunk pool takes from its allocator at a time
+#define MARS_STORAGE_SPARSE 0       // Components live in the system's own packed array
+#define MARS_STORAGE_ARCHETYPE 1    // Components live in the engine's archetype tables
+
+typedef struct {
+  signature_t signature;      // Component bit of every column
+  vector* systems;            // System owning each column, in bit order
+  vector* offsets;            // Byte offset of each column within a chunk
+  vector* chunks;             // Chunk allocations
+  size_t chunk_capacity;      // Rows per chunk
+  size_t chunk_size;          // Size (in bytes) of each chunk
+  size_t length;              // Rows in use
+  allocator* allocator;       // Source of the archetype and its lists
+  allocator* chunk_allocator; // Source of the chunks
+} Archetype;
+
+// Column of an archetype used by a system
+typedef struct {
+  Archetype* archetype;
+  size_t offset;
+} ArchetypeColumn;
+
+// Create an empty archetype for the given systems (System*, in bit order), allocating
+// through the first allocator and taking chunks from the second (NULL for malloc)
+MARS_API Archetype* archetype_create(signature_t, void**, size_t, allocator*, allocator*);
+
+// Append a row for the entity and return its index (SIZE_MAX on failure); columns are not initialized
+MARS_API size_t archetype_push(Archetype*, mars_id_t);
+
+// Allocate chunks up front so pushes can't fail until the archetype holds the given number of rows
+MARS_API uint8_t archetype_reserve(Archetype*, size_t);
+
+// Free the chunks past the last row
+MARS_API void archetype_shrink_to_fit(Archetype*);
+
+// Remove a row by moving the last row into it, returns the ID of the moved entity (ID_NULL if none)
+MARS_API mars_id_t archetype_remove(Archetype*, size_t);
+
+// Get a pointer to a row of a column (column 0 is the first component)
+MARS_API void* archetype_get(Archetype*, size_t, size_t);
+
+// Get the column of the system with the given bit (SIZE_MAX if the archetype has none)
+MARS_API size_t archetype_column(Archetype*, size_t);
+
+// Free the archetype without running component destroy functions
+MARS_API void archetype_destroy(Archetype*);
+
 
 /*=======================================================================================*/
 /* Entity                                                                                */
-/* Basic game object. Has a unique ID that is used to link it to components.             */
+/* Basic game object. Its ID is a generational handle into the engine's entity slots:    */
+/* the low bits are the slot index and the high bits count how often the slot was reused */
+/* (7 bits, so a stale handle is only caught until the slot wraps around). Indices are   */
+/* reused densely from zero, so they can index component sparse sets directly.           */
 /*=======================================================================================*/
 typedef struct {
-	id_t uuid;		        // Unique ID
+	mars_id_t uuid;		   // Handle (ID_NULL until added to an engine)
+	Archetype* archetype;	// Table holding the archetype-stored components (NULL if none)
+	size_t row;		        // Row within the archetype
+	signature_t signature;	// Bit of every system holding a component for the entity, in any storage
 } Entity;
 
+// Slot index of an entity handle
+static inline size_t entity_index(mars_id_t entity_id) {
+  return (size_t)__lot_key_index(entity_id);
+}
+
 // Create and initialize an entity
 MARS_API Entity* entity_create();
 
 // Free the resources associated with the entity
 MARS_API void entity_destroy(Entity*);
 
+// Packed index stored for an entity in a sparse array (SIZE_MAX if missing or the handle is stale)
+MARS_API size_t entity_sparse_find(vector*, const mars_id_t*, size_t, mars_id_t);
+
+// Store the packed index for an entity (SIZE_MAX to clear), growing the sparse array as needed
+MARS_API uint8_t entity_sparse_set(vector**, mars_id_t, size_t);
+
 
 /*=======================================================================================*/
 /* System                                                                                */
-/* Structs that manage a collection of components                                        */
+/* Structs that manage a collection of components. Components are stored by value in a  */
+/* packed array (sparse set), so iterating a system walks memory linearly. Pointers to   */
+/* components are only valid until the next component is added to or removed from the   */
+/* system.                                                                               */
+/*                                                                                       */
+/* Systems switched to archetype storage keep no components of their own. Their          */
+/* components live in the engine's archetype tables, are added & removed through the     */
+/* engine, and updates walk every archetype column the system owns, one chunk at a time. */
 /*=======================================================================================*/
 typedef struct {
-  unordered_map* components;  // Container for components
+  vector* sparse;             // Packed index of each entity, indexed by entity_index()
+  vector* components;         // Packed component data
+  vector* entities;           // Entity ID owning each packed component
   fptr_t init;                // Function to run when initializing component
+  fptr_t init_batch;          // Function to run once over a range of spawned components (overrides init)
   fptr_t update;              // Function to run when updating component
+  fptr_t update_batch;        // Function to run once per tick over all components (overrides update)
   fptr_t destroy;             // Function to run when freeing component
-  id_t uuid;                  // Unique ID
+  fptr_t destroy_batch;       // Function to run once over a list of freed components (overrides destroy)
+  size_t grain;               // Components per chunk when updating across threads (0 for one thread)
+  size_t scratch_size;        // Size (in bytes) of the scratch buffer given to each thread
+  size_t scratch_count;       // Number of allocated scratch buffers
+  void* scratch;              // Per-thread scratch buffers, indexed by mars_thread_index()
+  vector* reads;              // IDs of other systems whose components are read during update
+  vector* writes;             // IDs of other systems whose components are written during update
+  mars_id_t uuid;             // Unique ID
   size_t component_size;      // Size (in bytes) of each component
+  uint8_t storage;            // Where components live (MARS_STORAGE_*)
+  size_t bit;                 // Component bit within the engine (SIZE_MAX if none)
+  vector* columns;            // Archetype column of every archetype holding this system's components
+  allocator* allocator;       // Source of the system, its storage and scratch buffers (NULL for malloc)
+  Profile* profile;           // Update timings (NULL unless profiling)
 } System;
 
 // Create and initialize a system
 MARS_API System* system_create(size_t, fptr_t, fptr_t, fptr_t);
 
+// Create and initialize a system that allocates through the given allocator
+MARS_API System* system_create_alloc(size_t, fptr_t, fptr_t, fptr_t, allocator*);
+
 // Create a new component, add it to the system, and return a reference to it
-MARS_API uint8_t system_new_component(System*, id_t);
+MARS_API uint8_t system_new_component(System*, mars_id_t);
+
+// Copy a component into the system
+MARS_API uint8_t system_add_component(System*, mars_id_t, void*);
 
-// Add a component to a system
-MARS_API uint8_t system_add_component(System*, id_t, void*);
+// Remove the component of an entity from the system
+MARS_API uint8_t system_remove_component(System*, mars_id_t);
 
 // Get the component of a system
-MARS_API void* system_get_component(System*, id_t);
+MARS_API void* system_get_component(System*, mars_id_t);
+
+// Make room for the given number of components (and entity slots) without reallocating
+MARS_API uint8_t system_reserve(System*, size_t);
+
+// Return the memory the system's storage isn't using
+MARS_API uint8_t system_shrink_to_fit(System*);
+
+// Declare that the system's callbacks read components of another system
+MARS_API uint8_t system_add_read(System*, mars_id_t);
 
-// Update all components in the system
+// Declare that the system's callbacks write components of another system
+MARS_API uint8_t system_add_write(System*, mars_id_t);
+
+// Start or stop timing the system's updates when run by an engine. Stopping frees the samples.
+MARS_API uint8_t system_set_profiling(System*, bool);
+
+// Get the memory held by the system: its struct, storage, scratch buffers & profile, plus
+// the archetype chunk space of its columns when it uses archetype storage
+MARS_API uint8_t system_memory(System*, container_stats*);
+
+// Update all components in the system. If update_batch is set it is called once with
+// {component array, &count, &stride, dt}, otherwise update is called per component
+// with {component, dt}. Systems with a scratch size append the calling thread's
+// scratch buffer to the arguments.
 MARS_API void system_update(System*, float*);
 
+// Opt in to splitting the update across worker threads in chunks of the given number of
+// components (0 to opt out), giving each thread a scratch buffer of the given size.
+// update_batch is then called once per chunk.
+MARS_API uint8_t system_set_parallel(System*, size_t, size_t);
+
+// Update all components in the system, spread across the pool if the system opted in
+MARS_API void system_update_parallel(System*, float*, ThreadPool*);
+
 // Free all memory for this system
 MARS_API void system_destroy(System*);
 
 
+/*=======================================================================================*/
+/* Command Buffer                                                                        */
+/* Structural changes recorded during a tick and applied together once every system has */
+/* finished. Each thread records into its own buffer, so callbacks running on the pool   */
+/* never touch shared storage. Entities created this way get a pending handle (with      */
+/* ID_PENDING set) that other commands recorded in the same tick may refer to.           */
+/*                                                                                       */
+/* A flush applies creations first, in recording order, then additions & removals sorted */
+/* by system & entity so storage is touched in order, and destructions last. Additions & */
+/* removals of the same component keep their recording order within a buffer, so a       */
+/* remove followed by an add replaces the component. Commands recorded by callbacks      */
+/* while a flush is applied wait for the next flush.                                     */
+/*=======================================================================================*/
+#define MARS_COMMAND_ADD_COMPONENT 0
+#define MARS_COMMAND_REMOVE_COMPONENT 1
+#define MARS_COMMAND_DESTROY_ENTITY 2
+#define MARS_COMMAND_INDEX_BITS 24    // Bits of a pending handle holding the creation index
+
+typedef struct {
+  uint8_t type;               // MARS_COMMAND_*
+  mars_id_t entity;           // Target entity (may be pending)
+  mars_id_t system;           // Target system
+  size_t data;                // Offset of the component copy in the buffer data (SIZE_MAX for none)
+  size_t buffer;              // Buffer the command was recorded in
+  size_t seq;                 // Recording order within the buffer
+} Command;
+
+typedef struct {
+  vector* commands;           // Recorded commands
+  vector* data;               // Component copies for add commands
+  vector* created;            // Handle of each entity created by the buffer, once flushed
+  size_t creates;             // Number of entities created since the last flush
+  size_t __flushed;           // Commands taken by the running flush
+  size_t __flushed_data;      // Bytes of component data taken by the running flush
+} CommandBuffer;
+
+
+/*=======================================================================================*/
+/* Snapshot                                                                              */
+/* Binary image of a world: the entity slots, each system's packed storage and every     */
+/* archetype's chunks, each in its own section starting on a MARS_SNAPSHOT_ALIGN         */
+/* boundary. Slot arrays & vectors are written whole, header included, so a mapped file  */
+/* can be used in place. Entities store the number of their archetype instead of a       */
+/* pointer.                                                                              */
+/*                                                                                       */
+/* A snapshot only loads into a build with the same id size, word size & byte order, and */
+/* systems added in the same order with the same component sizes & storage.              */
+/*=======================================================================================*/
+#define MARS_SNAPSHOT_MAGIC "MARSSNAP"
+#define MARS_SNAPSHOT_VERSION 1
+#define MARS_SNAPSHOT_ALIGN 64          // Alignment of every section within the file
+#define MARS_SNAPSHOT_ORDER 0x01020304  // Written in native byte order to detect a mismatch
+#define MARS_SECTION_ENTITIES 0         // Entity slot array
+#define MARS_SECTION_SPARSE 1           // Sparse index of a system
+#define MARS_SECTION_COMPONENTS 2       // Packed components of a system {component size, storage}
+#define MARS_SECTION_OWNERS 3           // Entity owning each packed component of a system
+#define MARS_SECTION_ARCHETYPE 4        // Chunks of an archetype {signature, rows, chunk size}
+#define MARS_LOAD_COPY 0                // Copy each section into engine memory
+#define MARS_LOAD_MAP 1                 // Map the file & use the slot array and system storage in place
+
+typedef struct {
+  char magic[8];              // MARS_SNAPSHOT_MAGIC
+  uint32_t version;           // MARS_SNAPSHOT_VERSION
+  uint32_t order;             // MARS_SNAPSHOT_ORDER
+  uint32_t id_size;           // Size (in bytes) of mars_id_t
+  uint32_t word_size;         // Size (in bytes) of size_t
+  uint32_t entity_size;       // Size (in bytes) of Entity
+  uint32_t systems;           // Number of systems
+  uint64_t size;              // Size (in bytes) of the file
+  uint64_t sections;          // Number of sections, listed right after the header
+} SnapshotHeader;
+
+typedef struct {
+  uint32_t type;              // MARS_SECTION_*
+  uint32_t index;             // System or archetype the section belongs to
+  uint64_t offset;            // Start within the file
+  uint64_t size;              // Size (in bytes)
+  uint64_t info[3];           // Extra values, depending on the type
+} SnapshotSection;
+
+
 /*=======================================================================================*/
 /* Engine                                                                                */
 /* Highest level container for game state. Contains pointers to other critical modules,  */
 /* timing information for measuring time between frames, and pointers to initialization  */
 /* and destruction functions.                                                            */
+/*                                                                                       */
+/* Systems run in the order they were added. With worker threads enabled, each tick is   */
+/* split into phases of systems whose declared component access does not conflict, and   */
+/* the systems in a phase run in parallel. A system always writes its own components.    */
+/*                                                                                       */
+/* Every thread has a pair of frame arenas for memory that only lives for a tick or two. */
+/* Each tick allocates from one arena of the pair. Once the tick ends the other arena is */
+/* emptied and takes over, so frame memory stays valid until the end of the next tick.   */
+/*                                                                                       */
+/* When steps take longer than dt, engine_update would have to run ever more steps per   */
+/* frame to catch up. The accumulated time is clamped and the steps per frame capped;    */
+/* time left over at the cap is either carried into the next frame or, with dilation,    */
+/* dropped so the simulation runs slower than real time until the load passes.           */
 /*=======================================================================================*/
+#define MARS_FRAME_ARENA_SIZE 65536   // Initial size (in bytes) of each frame arena
+#define MARS_LOOP_SLEEP 0             // Sleep until the next step is due
+#define MARS_LOOP_SPIN 1              // Poll the clock continuously, for frames between steps
+#define MARS_LOOP_MAX_SPEED 2         // Step back to back, ignoring the clock (headless simulation & replay)
+#define MARS_MAX_STEPS 8              // Default most steps run per frame
+#define MARS_MAX_ACCUM 0.25f          // Default most time (in seconds) the accumulator may hold
+
+// Counters kept by engine_update, for spotting overload
+typedef struct {
+  size_t frames;              // Frames run (each runs zero or more steps)
+  size_t steps;               // Steps run
+  size_t last_steps;          // Steps run by the most recent frame
+  size_t max_steps;           // Most steps run by a single frame
+  size_t overruns;            // Frames that stopped at the step cap with time left over
+  size_t clamps;              // Frames whose accumulated time was clamped
+  double dropped;             // Time (in seconds) skipped by clamping & dilation
+} EngineLoopStats;
 typedef struct {
 	fptr_t init;                      // Function run when engine is created
 	fptr_t destroy;                   // Function run when engine is destroyed
-	struct timeval old_time;          // Time used when calculating dt between frames
-	struct timeval new_time;
+	uint64_t old_time;                // Monotonic time (ns) used when calculating dt between frames
+	uint8_t loop_mode;                // How engine_update waits between steps (MARS_LOOP_*)
+	size_t max_steps;                 // Most steps run per frame (0 for no limit)
+	float max_accum;                  // Most time (in seconds) the accumulator may hold (0 for no limit)
+	bool dilate;                      // Drop the time left over at the step cap instead of carrying it
+	EngineLoopStats loop_stats;       // Frame & overrun counters
+	size_t step;                      // Steps run by engine_step in any loop mode
+	bool profiling;                   // Time every system update & engine step
+	Profile* profile;                 // Engine step timings (NULL unless profiling)
 	float time_accum;                 // Accumulator for time measured between frames
 	float render_alpha;               // Scalar for frame interpolation
 	float dt;                         // Time (in seconds) that should pass between game cycles
 	bool run;                         // Continue running the game loop
 	unordered_map* systems;           // Hash table containing all systems
-	unordered_map* entities;          // Hash table containing all entities
+	lot* entities;                    // Slot array of all entities, indexed by handle
+	vector* system_order;             // Systems in the order they were added
+	vector* schedule;                 // Systems sorted into conflict-free phases
+	vector* schedule_phase;           // Phase of each scheduled system
+	ThreadPool* pool;                 // Worker threads (NULL to run single threaded)
+	vector* archetypes;               // Every archetype, in creation order
+	unordered_map* archetype_index;   // Maps a signature to its archetype
+	vector* queries;                  // Queries matched against every new archetype
+	CommandBuffer* commands;          // Command buffer of each thread, indexed by mars_thread_index()
+	size_t command_count;             // Number of command buffers
+	size_t command_capacity;          // Number of allocated command buffers
+	vector* command_sort;             // Scratch list of commands being flushed
+	vector* destroy_list;             // Scratch list of entities being destroyed
+	vector* destroy_components;       // Scratch list of their components, grouped by system
+	allocator* allocator;             // Source of all engine memory (&heap unless one was given)
+	HeapAllocator heap;               // Default allocator, counting what the engine allocates
+	PoolAllocator* chunk_pool;        // Archetype chunks, kept for reuse once freed
+	FrameArena** frames;              // Frame arena pair of each thread, indexed by 2 * mars_thread_index() + frame
+	size_t frame_count;               // Number of frame arena pairs
+	size_t frame_capacity;            // Number of frame arena pairs the list was allocated for
+	size_t frame;                     // Arena of each pair taking allocations this tick (0 or 1)
+	void* snapshot;                   // Mapped snapshot holding loaded containers (NULL if none)
+	size_t snapshot_size;             // Size (in bytes) of the mapping
+	allocator snapshot_allocator;     // Moves loaded containers out of the mapping once they resize
 } Engine;
 
+#define MARS_ITER_COMPONENTS 8
+
+// Archetype matched by a query, with the offset of each requested column
+typedef struct {
+  Archetype* archetype;
+  size_t offsets[MARS_ITER_COMPONENTS];
+} QueryMatch;
+
+// Cached set of archetypes holding all of some components and none of others. Archetypes
+// are never removed, so a query only has to look at each new archetype once; entities
+// gaining or losing components just move between archetypes.
+typedef struct {
+  signature_t with;           // Components every match holds
+  signature_t without;        // Components no match holds
+  size_t count;               // Number of requested components
+  size_t bits[MARS_ITER_COMPONENTS];  // Bit of each requested component, in request order
+  vector* matches;            // Matching archetypes
+} Query;
+
+// Walks the chunks of every archetype holding all of the requested components
+typedef struct {
+  size_t length;                          // Rows in the current chunk
+  mars_id_t* entities;                    // Entity of each row
+  void* columns[MARS_ITER_COMPONENTS];    // Requested components of each row, in request order
+  vector* __archetypes;
+  Query* __query;
+  size_t __archetype;
+  size_t __chunk;
+  size_t __count;
+  signature_t __signature;
+  size_t __bits[MARS_ITER_COMPONENTS];
+} ArchetypeIter;
+
+#define archetype_iter_done(i) ((i)->entities == NULL)
+
 // Create and initialize an engine
 MARS_API Engine* engine_create(fptr_t, fptr_t, int, char**);
 
+// Create and initialize an engine that allocates itself, its systems, entities, archetypes,
+// queries & command buffers through the given allocator (NULL for the engine's own heap
+// allocator). The allocator must be thread-safe if worker threads are enabled.
+MARS_API Engine* engine_create_alloc(fptr_t, fptr_t, int, char**, allocator*);
+
 // Create a new system, add it to the engine, and return a reference to it
-MARS_API id_t engine_new_system(Engine*, size_t, fptr_t, fptr_t, fptr_t);
+MARS_API mars_id_t engine_new_system(Engine*, size_t, fptr_t, fptr_t, fptr_t);
 
 // Add a system to the engine
 MARS_API uint8_t engine_add_system(Engine*, System*);
 
 // Get a pointer to the given system
-MARS_API System* engine_get_system(Engine*, id_t);
+MARS_API System* engine_get_system(Engine*, mars_id_t);
 
 // Create a new entity, add it to the engine, and return a reference to it
-MARS_API id_t engine_new_entity(Engine*);
+MARS_API mars_id_t engine_new_entity(Engine*);
 
-// Add an entity to the engine
+// Add a copy of an entity to the engine and write its new handle back (caller keeps ownership)
 MARS_API uint8_t engine_add_entity(Engine*, Entity*);
 
-// Get a pointer to the given entity
-MARS_API Entity* engine_get_entity(Engine*, id_t);
+// Get a pointer to the given entity (NULL for stale handles), valid until the next entity is added
+MARS_API Entity* engine_get_entity(Engine*, mars_id_t);
 
 // Give a component for the given system to the given entity
-MARS_API uint8_t engine_new_entity_component(Engine*, id_t, id_t);
+MARS_API uint8_t engine_new_entity_component(Engine*, mars_id_t, mars_id_t);
+
+// Copy a component for the given system into the given entity
+MARS_API uint8_t engine_add_entity_component(Engine*, mars_id_t, mars_id_t, void*);
+
+// Remove the component for the given system from the given entity
+MARS_API uint8_t engine_remove_entity_component(Engine*, mars_id_t, mars_id_t);
 
 // Get the component for the given entity from the given system
-MARS_API void* engine_get_entity_component(Engine*, id_t, id_t);
+MARS_API void* engine_get_entity_component(Engine*, mars_id_t, mars_id_t);
+
+// Create the given number of entities, writing their handles to the given array, and give
+// each a copy of a prototype component (NULL for zeroed) for every listed system. Storage
+// is reserved once and filled in contiguous ranges. A system's init_batch is called once
+// per range with {component array, &count, &stride, entity array}, otherwise init runs per
+// component as usual.
+MARS_API uint8_t engine_spawn_entities(Engine*, mars_id_t*, size_t, mars_id_t*, void**, size_t);
+
+// Remove an entity and all of its components from the engine
+MARS_API uint8_t engine_destroy_entity(Engine*, mars_id_t);
+
+// Remove several entities, running each system's destroy function over all of their components
+// in one pass. A system's destroy_batch is called once with {component pointer array, &count},
+// otherwise destroy runs per component. Every component pointer is gathered before the first
+// destroy function runs, so destroy functions must not add, remove or destroy anything
+// directly (record it with the engine_defer_* functions instead). Components are found through
+// the entity signatures, so ones added with the system_* functions directly are left behind.
+MARS_API uint8_t engine_destroy_entities(Engine*, mars_id_t*, size_t);
+
+// Record the creation of an entity, returns its pending handle
+MARS_API mars_id_t engine_defer_new_entity(Engine*);
+
+// Record giving an entity a new component for the given system
+MARS_API uint8_t engine_defer_new_entity_component(Engine*, mars_id_t, mars_id_t);
+
+// Record copying a component for the given system into an entity (the data is copied now)
+MARS_API uint8_t engine_defer_add_entity_component(Engine*, mars_id_t, mars_id_t, void*);
+
+// Record removing the component for the given system from an entity
+MARS_API uint8_t engine_defer_remove_entity_component(Engine*, mars_id_t, mars_id_t);
+
+// Record removing an entity and all of its components
+MARS_API uint8_t engine_defer_destroy_entity(Engine*, mars_id_t);
+
+// Apply every recorded command. Runs at the end of each tick; only call it while no
+// system is updating.
+MARS_API void engine_flush(Engine*);
+
+// Move a system's components to the engine's archetype tables or back (MARS_STORAGE_*).
+// The system must not hold any components yet.
+MARS_API uint8_t engine_set_system_storage(Engine*, mars_id_t, uint8_t);
+
+// Find or create the archetype holding a component of each system bit in the signature
+MARS_API Archetype* engine_get_archetype(Engine*, signature_t);
+
+// Start walking every archetype that holds components of all the given (archetype-stored)
+// systems. Pointers are valid until the next structural change.
+MARS_API void engine_archetype_iter(Engine*, ArchetypeIter*, mars_id_t*, size_t);
+
+// Move to the next chunk
+MARS_API void archetype_iter_next(ArchetypeIter*);
+
+// Create a query for entities holding all of the first (archetype-stored) systems and none
+// of the second, iterated in the order of the first. Freed along with the engine.
+MARS_API Query* engine_new_query(Engine*, mars_id_t*, size_t, mars_id_t*, size_t);
+
+// Free a query before the engine is destroyed
+MARS_API void engine_destroy_query(Engine*, Query*);
+
+// Start walking the chunks matched by a query, with columns in request order
+MARS_API void query_iter(Query*, ArchetypeIter*);
+
+// Number of entities matched by a query
+MARS_API size_t query_length(Query*);
+
+// Run systems on the given number of worker threads (0 to run single threaded)
+MARS_API uint8_t engine_set_threads(Engine*, size_t);
+
+// Allocate memory (MARS_ALLOCATOR_ALIGN aligned) from the calling thread's frame arena. It is
+// valid until the end of the next tick and is never freed. Safe to call from update callbacks.
+MARS_API void* engine_frame_alloc(Engine*, size_t);
+
+// Get an allocator over the calling thread's frame arena, for containers that only live
+// until the end of the next tick. Destroying them is optional.
+MARS_API allocator* engine_frame_allocator(Engine*);
+
+// Make room for the given number of entities, in the entity slots & every sparse system's index
+MARS_API uint8_t engine_reserve(Engine*, size_t);
+
+// Return the memory the engine's tables, systems & archetypes aren't using, e.g. after a large
+// despawn. Entity slots that were ever used are kept, so stale handles stay stale. Only call it
+// while no system is updating.
+MARS_API uint8_t engine_shrink_to_fit(Engine*);
+
+// Choose how engine_update waits between steps (MARS_LOOP_*, MARS_LOOP_SLEEP by default)
+MARS_API uint8_t engine_set_loop_mode(Engine*, uint8_t);
+
+// Limit how engine_update catches up after slow frames: the most steps per frame and the
+// most accumulated time (0 for no limit), and whether time left over at the step cap is
+// dropped (dilating time) rather than carried into the next frame
+MARS_API uint8_t engine_set_catch_up(Engine*, size_t, float, bool);
+
+// Start or stop timing every system update & engine step, including systems added later
+MARS_API uint8_t engine_set_profiling(Engine*, bool);
+
+// Get the update statistics of a system (it must be profiled)
+MARS_API uint8_t engine_system_profile(Engine*, mars_id_t, ProfileStats*);
+
+// Write the statistics of the engine step and every profiled system (MARS_PROFILE_*)
+MARS_API uint8_t engine_profile_dump(Engine*, FILE*, uint8_t);
+
+// Get the memory held by a system (see system_memory)
+MARS_API uint8_t engine_system_memory(Engine*, mars_id_t, container_stats*);
+
+// Get the memory held by the engine: its tables, every system & archetype, the chunk pool,
+// queries, command buffers, frame arenas & worker threads. Each part is counted once.
+MARS_API uint8_t engine_memory(Engine*, container_stats*);
+
+// Write the world to a snapshot file. Commands still waiting for a flush are not written.
+MARS_API uint8_t engine_save(Engine*, const char*);
+
+// Restore a snapshot into an engine without entities (MARS_LOAD_*). Components come back
+// byte for byte, init functions are not run. A mapping stays open until the engine is
+// destroyed.
+MARS_API uint8_t engine_load(Engine*, const char*, uint8_t);
+
+// Advance the game state by one dt: update every system, apply recorded commands & start
+// the next frame. For driving the engine from an outside loop instead of engine_update.
+MARS_API void engine_step(Engine*);
 
-// Updates the given engine game state
+// Run fixed dt steps until engine->run is cleared, keeping pace with the monotonic clock
+// unless the loop mode is MARS_LOOP_MAX_SPEED
 MARS_API void engine_update(Engine*);
 
 // Free all modules associated with the engine
@@ -0,0 +1,71 @@
+/*
+ *  mars_trace.h
+ *  Timeline of engine ticks, system updates, structural changes and container resizes,
+ *  written in the Chrome Trace Event format for Perfetto or chrome://tracing. Everything
+ *  compiles to nothing unless MARS_TRACE is defined.
+ */
+#ifndef MARS_TRACE_H
+#define MARS_TRACE_H
+
+#ifdef MARS_TRACE
+#include "mars_core.h"   // Core definitions
+
+/*=======================================================================================*/
+/* Trace                                                                                 */
+/* Each thread records begin & end events into its own fixed ring, so recording never    */
+/* takes a lock. A flush drains every ring into the open trace file; events recorded     */
+/* while a ring is full are dropped and counted. Rings are claimed on first use and      */
+/* released when a pool worker exits, other threads release theirs themselves. Events    */
+/* from a thread that finds every ring owned are dropped and counted too. Event names    */
+/* must be string literals.                                                              */
+/*=======================================================================================*/
+#define MARS_TRACE_THREADS 32     // Threads that can record events at the same time
+#define MARS_TRACE_EVENTS 16384   // Events each thread can hold between flushes
+
+typedef struct {
+  const char* name;           // Event name (string literal)
+  uint64_t time;              // Monotonic time (ns)
+  uint64_t id;                // Extra value shown with the event (e.g. a system ID)
+  char phase;                 // 'B' for begin, 'E' for end
+} TraceEvent;
+
+typedef struct {
+  TraceEvent events[MARS_TRACE_EVENTS];   // Recorded events, indexed by count % MARS_TRACE_EVENTS
+  volatile size_t head;       // Events recorded by the owning thread
+  volatile size_t tail;       // Events written out by flushes
+  volatile size_t dropped;    // Events lost to a full ring
+  volatile size_t owned;      // Set while a thread records into the ring
+} TraceRing;
+
+// Record an event on the calling thread's ring (ignored while no trace file is open)
+MARS_API void mars_trace_event(const char*, char, uint64_t);
+
+// Give up the calling thread's ring so another thread can claim it, call before a thread exits
+MARS_API void mars_trace_release();
+
+// Start writing a trace to the given file, events are recorded from now on
+MARS_API uint8_t mars_trace_open(const char*);
+
+// Write out every recorded event, called by engine_update once per frame
+MARS_API uint8_t mars_trace_flush();
+
+// Flush, finish & close the trace file, returns the number of dropped events
+MARS_API size_t mars_trace_close();
+
+#define MARS_TRACE_BEGIN(n, i) mars_trace_event(n, 'B', (uint64_t)(i))
+#define MARS_TRACE_END(n, i) mars_trace_event(n, 'E', (uint64_t)(i))
+#else
+#include <stdint.h>
+#include <stddef.h>
+
+#define MARS_TRACE_BEGIN(n, i)
+#define MARS_TRACE_END(n, i)
+
+// Tracing is compiled out, there is never a trace to write
+static inline void mars_trace_release() {}
+static inline uint8_t mars_trace_open(const char* path) { return 1; }
+static inline uint8_t mars_trace_flush() { return 1; }
+static inline size_t mars_trace_close() { return 0; }
+#endif
+
+#endif  // MARS_TRACE_H
\ No newline at end of file
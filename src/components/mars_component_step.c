@@ -6,7 +6,7 @@
 uint8_t component_step_init(size_t num, void** args) {
   // Get reference
   ComponentStep *data = (ComponentStep*)args[0];
-  id_t uuid = *(id_t*)args[1];
+  mars_id_t uuid = *(mars_id_t*)args[1];
   // Set values
   data->entity_id = uuid;
   data->event = NULL;
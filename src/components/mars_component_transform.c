@@ -2,11 +2,23 @@
   #define MARS_EXPORTS
 #endif
 #include "mars/components/mars_component_transform.h"
+#ifdef MARS_X86
+  #include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define MARS_TARGET(t) __attribute__((target(t)))
+#else
+  #define MARS_TARGET(t)
+#endif
+
+#define TRANSFORM_SOA_ALIGN 32
+#define TRANSFORM_SOA_DEFAULT_CAPACITY 32
 
 uint8_t component_transform_init(size_t num, void** args) {
   // Get reference
   ComponentTransform *data = (ComponentTransform*)args[0];
-  id_t uuid = *(id_t*)args[1];
+  mars_id_t uuid = *(mars_id_t*)args[1];
   // Set values
   data->entity_id = uuid;
 	data->x = 0.0f;
@@ -29,4 +41,269 @@ uint8_t component_transform_update(size_t num, void** args) {
 	data->l_x = _x_;
 	data->l_y = _y_;
   return 0;
+}
+
+uint8_t component_transform_update_batch(size_t num, void** args) {
+  // Get references
+  uint8_t* data = (uint8_t*)args[0];
+  size_t count = *(size_t*)args[1];
+  size_t stride = *(size_t*)args[2];
+  float dt = *(float*)args[3];
+  float dt2 = dt*dt;
+  // Verlet integration
+  for (size_t i = 0; i < count; ++i) {
+    ComponentTransform* t = (ComponentTransform*)(data + (i * stride));
+    float _x_ = t->x;
+    float _y_ = t->y;
+    t->x = (2.0f*_x_) - (t->l_x) + (dt2*(t->acc));
+    t->y = (2.0f*_y_) - (t->l_y) + (dt2*(t->acc));
+    t->l_x = _x_;
+    t->l_y = _y_;
+  }
+  return 0;
+}
+
+
+/*=======================================================*/
+/* Integration kernels                                   */
+/* Every kernel evaluates (2*x - l_x) + (dt*dt*acc) in   */
+/* the same order as component_transform_update, so     */
+/* results match the scalar path bit for bit.            */
+/*=======================================================*/
+typedef void (*transform_kernel_t)(ComponentTransformSoA*, size_t, float);
+
+static void transform_kernel_scalar(ComponentTransformSoA* soa, size_t begin, float dt2) {
+  for (size_t i = begin; i < soa->length; ++i) {
+    float _x_ = soa->x[i];
+    float _y_ = soa->y[i];
+    soa->x[i] = (2.0f*_x_) - (soa->l_x[i]) + (dt2*(soa->acc[i]));
+    soa->y[i] = (2.0f*_y_) - (soa->l_y[i]) + (dt2*(soa->acc[i]));
+    soa->l_x[i] = _x_;
+    soa->l_y[i] = _y_;
+  }
+}
+
+#ifdef MARS_X86
+MARS_TARGET("sse2")
+static void transform_kernel_sse2(ComponentTransformSoA* soa, size_t begin, float dt2) {
+  const __m128 two = _mm_set1_ps(2.0f);
+  const __m128 k = _mm_set1_ps(dt2);
+  size_t i = begin;
+  for (; i + 4 <= soa->length; i += 4) {
+    __m128 x = _mm_load_ps(soa->x + i);
+    __m128 y = _mm_load_ps(soa->y + i);
+    __m128 a = _mm_mul_ps(k, _mm_load_ps(soa->acc + i));
+    _mm_store_ps(soa->x + i, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(two, x), _mm_load_ps(soa->l_x + i)), a));
+    _mm_store_ps(soa->y + i, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(two, y), _mm_load_ps(soa->l_y + i)), a));
+    _mm_store_ps(soa->l_x + i, x);
+    _mm_store_ps(soa->l_y + i, y);
+  }
+  transform_kernel_scalar(soa, i, dt2);
+}
+
+MARS_TARGET("avx2")
+static void transform_kernel_avx2(ComponentTransformSoA* soa, size_t begin, float dt2) {
+  const __m256 two = _mm256_set1_ps(2.0f);
+  const __m256 k = _mm256_set1_ps(dt2);
+  size_t i = begin;
+  for (; i + 8 <= soa->length; i += 8) {
+    __m256 x = _mm256_load_ps(soa->x + i);
+    __m256 y = _mm256_load_ps(soa->y + i);
+    __m256 a = _mm256_mul_ps(k, _mm256_load_ps(soa->acc + i));
+    _mm256_store_ps(soa->x + i, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(two, x), _mm256_load_ps(soa->l_x + i)), a));
+    _mm256_store_ps(soa->y + i, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(two, y), _mm256_load_ps(soa->l_y + i)), a));
+    _mm256_store_ps(soa->l_x + i, x);
+    _mm256_store_ps(soa->l_y + i, y);
+  }
+  transform_kernel_sse2(soa, i, dt2);
+}
+
+#ifndef MARS_DETERMINISTIC
+MARS_TARGET("avx2,fma")
+static void transform_kernel_avx2_fma(ComponentTransformSoA* soa, size_t begin, float dt2) {
+  const __m256 two = _mm256_set1_ps(2.0f);
+  const __m256 k = _mm256_set1_ps(dt2);
+  size_t i = begin;
+  for (; i + 8 <= soa->length; i += 8) {
+    __m256 x = _mm256_load_ps(soa->x + i);
+    __m256 y = _mm256_load_ps(soa->y + i);
+    __m256 a = _mm256_load_ps(soa->acc + i);
+    _mm256_store_ps(soa->x + i, _mm256_fmadd_ps(k, a, _mm256_fmsub_ps(two, x, _mm256_load_ps(soa->l_x + i))));
+    _mm256_store_ps(soa->y + i, _mm256_fmadd_ps(k, a, _mm256_fmsub_ps(two, y, _mm256_load_ps(soa->l_y + i))));
+    _mm256_store_ps(soa->l_x + i, x);
+    _mm256_store_ps(soa->l_y + i, y);
+  }
+  transform_kernel_sse2(soa, i, dt2);
+}
+#endif
+#endif
+
+static transform_kernel_t transform_kernel = NULL;
+static uint8_t transform_simd = MARS_SIMD_NONE;
+
+uint8_t component_transform_set_simd(uint8_t simd) {
+  // Only select instruction sets the CPU can run
+  uint8_t support = mars_simd_support();
+  if ((simd & support) != simd) { return 1; }
+
+  // Pick the widest kernel requested
+  transform_simd = MARS_SIMD_NONE;
+  transform_kernel = transform_kernel_scalar;
+  #ifdef MARS_X86
+    if (simd & MARS_SIMD_AVX2) {
+      transform_simd = MARS_SIMD_AVX2;
+      transform_kernel = transform_kernel_avx2;
+      #ifndef MARS_DETERMINISTIC
+        if (simd & MARS_SIMD_FMA) {
+          transform_simd |= MARS_SIMD_FMA;
+          transform_kernel = transform_kernel_avx2_fma;
+        }
+      #endif
+    }
+    else if (simd & MARS_SIMD_SSE2) {
+      transform_simd = MARS_SIMD_SSE2;
+      transform_kernel = transform_kernel_sse2;
+    }
+  #endif
+  return 0;
+}
+
+uint8_t component_transform_get_simd() {
+  if (!transform_kernel) { component_transform_set_simd(mars_simd_support()); }
+  return transform_simd;
+}
+
+
+/*=======================================================*/
+/* Transform Storage (SoA)                               */
+/*=======================================================*/
+
+// Point every field array into a fresh block large enough for the given capacity
+static uint8_t component_transform_soa_alloc(ComponentTransformSoA* soa, size_t capacity) {
+  // Keep every array a multiple of the alignment
+  capacity = (capacity + 7) & ~(size_t)7;
+  size_t ids = (sizeof(mars_id_t) * capacity + (TRANSFORM_SOA_ALIGN - 1)) & ~(size_t)(TRANSFORM_SOA_ALIGN - 1);
+  size_t floats = sizeof(float) * capacity;
+  void* block = malloc(ids + (floats * 5) + (TRANSFORM_SOA_ALIGN - 1));
+  if (!block) { return 1; }
+  uint8_t* base = (uint8_t*)(((uintptr_t)block + (TRANSFORM_SOA_ALIGN - 1)) & ~(uintptr_t)(TRANSFORM_SOA_ALIGN - 1));
+
+  // Carry existing data over
+  mars_id_t* entity_id = (mars_id_t*)base;
+  float* fields[5];
+  for (size_t f = 0; f < 5; ++f) {
+    fields[f] = (float*)(base + ids + (floats * f));
+  }
+  if (soa->__block) {
+    memcpy(entity_id, soa->entity_id, sizeof(mars_id_t) * soa->length);
+    memcpy(fields[0], soa->x, sizeof(float) * soa->length);
+    memcpy(fields[1], soa->y, sizeof(float) * soa->length);
+    memcpy(fields[2], soa->l_x, sizeof(float) * soa->length);
+    memcpy(fields[3], soa->l_y, sizeof(float) * soa->length);
+    memcpy(fields[4], soa->acc, sizeof(float) * soa->length);
+    free(soa->__block);
+  }
+  soa->entity_id = entity_id;
+  soa->x = fields[0];
+  soa->y = fields[1];
+  soa->l_x = fields[2];
+  soa->l_y = fields[3];
+  soa->acc = fields[4];
+  soa->capacity = capacity;
+  soa->__block = block;
+  return 0;
+}
+
+ComponentTransformSoA* component_transform_soa_create(size_t capacity) {
+  // Assign default values
+  ComponentTransformSoA* soa = malloc(sizeof(*soa));
+  if (!soa) { return NULL; }
+  soa->length = 0;
+  soa->__block = NULL;
+  soa->sparse = vector_create(size_t);
+  if (!soa->sparse) {
+    free(soa);
+    return NULL;
+  }
+
+  // Allocate field arrays
+  if (component_transform_soa_alloc(soa, capacity > 0 ? capacity : TRANSFORM_SOA_DEFAULT_CAPACITY) > 0) {
+    vector_destroy(soa->sparse);
+    free(soa);
+    return NULL;
+  }
+  return soa;
+}
+
+size_t component_transform_soa_add(ComponentTransformSoA* soa, mars_id_t entity_id) {
+  // Error check
+  if (!soa || component_transform_soa_find(soa, entity_id) != SIZE_MAX) { return SIZE_MAX; }
+
+  // Resize if needed
+  if (soa->length >= soa->capacity) {
+    if (component_transform_soa_alloc(soa, soa->capacity * 2) > 0) { return SIZE_MAX; }
+  }
+
+  // Map entity to index
+  size_t index = soa->length;
+  if (entity_sparse_set(&soa->sparse, entity_id, index) > 0) { return SIZE_MAX; }
+
+  // Set values
+  soa->entity_id[index] = entity_id;
+  soa->x[index] = 0.0f;
+  soa->y[index] = 0.0f;
+  soa->l_x[index] = 0.0f;
+  soa->l_y[index] = 0.0f;
+  soa->acc[index] = 0.0f;
+  soa->length++;
+  return index;
+}
+
+size_t component_transform_soa_find(ComponentTransformSoA* soa, mars_id_t entity_id) {
+  // Error check
+  if (!soa) { return SIZE_MAX; }
+
+  // Attempt to find
+  return entity_sparse_find(soa->sparse, soa->entity_id, soa->length, entity_id);
+}
+
+uint8_t component_transform_soa_remove(ComponentTransformSoA* soa, mars_id_t entity_id) {
+  // Error check
+  if (!soa) { return 1; }
+
+  // Find index
+  size_t index = component_transform_soa_find(soa, entity_id);
+  if (index == SIZE_MAX) { return 1; }
+
+  // Move the last transform into the hole
+  size_t last = soa->length - 1;
+  if (index != last) {
+    soa->entity_id[index] = soa->entity_id[last];
+    soa->x[index] = soa->x[last];
+    soa->y[index] = soa->y[last];
+    soa->l_x[index] = soa->l_x[last];
+    soa->l_y[index] = soa->l_y[last];
+    soa->acc[index] = soa->acc[last];
+    entity_sparse_set(&soa->sparse, soa->entity_id[index], index);
+  }
+  entity_sparse_set(&soa->sparse, entity_id, SIZE_MAX);
+  soa->length--;
+  return 0;
+}
+
+void component_transform_soa_update(ComponentTransformSoA* soa, float dt) {
+  // Error check
+  if (!soa) { return; }
+
+  // Select a kernel the first time through
+  if (!transform_kernel) { component_transform_set_simd(mars_simd_support()); }
+  transform_kernel(soa, 0, dt*dt);
+}
+
+void component_transform_soa_destroy(ComponentTransformSoA* soa) {
+  if (soa) {
+    vector_destroy(soa->sparse);
+    free(soa->__block);
+  }
+  free(soa);
 }
\ No newline at end of file
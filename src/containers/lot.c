@@ -1,51 +1,79 @@
 #include "mars/containers/lot.h"
+#include "mars/mars_trace.h"
+
+lot* __lot_factory(size_t element_size, size_t capacity, allocator* alloc) {
+  // Error check
+  if (capacity > __LOT_MAX_CAPACITY) { return NULL; }
 
-lot* __lot_factory(size_t element_size, size_t capacity) {
   // Construct object
-  lot* lt = malloc(offsetof(lot, __buffer) + (sizeof(__lot_key_t) * capacity) + (__lot_node_size(element_size) * capacity));
+  lot* lt = __allocator_alloc(alloc, __lot_bytes(element_size, capacity));
   if (!lt) { return NULL; }
   lt->length = 0;
   lt->__capacity = capacity;
   lt->__element_size = element_size;
   lt->__stack_head = 0;
-  // Initialize buffer
+  lt->__peak = lot_bytes(lt);
+  lt->__resizes = 0;
+  lt->__allocator = alloc;
+  // Initialize buffer, stacking indices so the lowest is handed out first
   memset(__lot_node(lt, 0), 0, __lot_node_size(element_size) * capacity);
-  for (size_t i = 0; i < capacity; ++i) {
-    __lot_stack_push(lt, i);
+  for (size_t i = capacity; i > 0; --i) {
+    size_t index = i - 1;
+    __lot_stack_push(lt, index);
   }
   return lt;
 }
 
 lot* __lot_resize(lot* lt, size_t new_capacity) {
-  // Create new lot & copy data to it
-  lot* new_lt = __lot_factory(lt->__element_size, new_capacity);
-  if (!new_lt) { return NULL; }
-  memcpy(__lot_node_ctrl(new_lt, 0), __lot_node_ctrl(lt, 0), __lot_node_size(lt->__element_size) * lt->length);
+  // Create new lot & copy every node that fits, occupied slots must all be below the new capacity
+  MARS_TRACE_BEGIN("lot_resize", new_capacity);
+  lot* new_lt = __lot_factory(lt->__element_size, new_capacity, lt->__allocator);
+  if (!new_lt) {
+    MARS_TRACE_END("lot_resize", new_capacity);
+    return NULL;
+  }
+  size_t nodes = (lt->__capacity < new_capacity) ? lt->__capacity : new_capacity;
+  memcpy(__lot_node_ctrl(new_lt, 0), __lot_node_ctrl(lt, 0), __lot_node_size(lt->__element_size) * nodes);
   new_lt->length = lt->length;
-  new_lt->__stack_head = lt->__stack_head;
-  
-  // Push new array entries
-  for (size_t i = lt->__capacity; i < new_capacity; ++i) {
-    __lot_stack_push(new_lt, i);
+  new_lt->__resizes = lt->__resizes + 1;
+  new_lt->__peak = lt->__peak;
+  __container_peak(new_lt->__peak, lot_bytes(new_lt));
+
+  // Rebuild the free stack from the control bytes, lowest on top
+  new_lt->__stack_head = 0;
+  for (size_t i = new_capacity; i > 0; --i) {
+    size_t index = i - 1;
+    if (!(*__lot_node_ctrl(new_lt, index) & 0x80)) {
+      __lot_stack_push(new_lt, index);
+    }
   }
-  free(lt);
+  __lot_destroy(lt);
+  MARS_TRACE_END("lot_resize", new_capacity);
   return new_lt;
 }
 
+void __lot_destroy(lot* lt) {
+  if (lt) {
+    __allocator_free(lt->__allocator, lt, lot_bytes(lt));
+  }
+}
+
 uint8_t __lot_insert(lot** lt, __lot_key_t* key, void* data) {
   // Error check
   if (!lt || !(*lt)) { return 1; }
 
-  // Resize if needed
+  // Resize if needed, indices must stay addressable by a key
   if ((*lt)->length >= (*lt)->__capacity) {
-    lot* temp = __lot_resize(*lt, (*lt)->__capacity * 2);
+    if ((*lt)->__capacity >= __LOT_MAX_CAPACITY) { return 1; }
+    size_t capacity = ((*lt)->__capacity < __LOT_MAX_CAPACITY / 2) ? (*lt)->__capacity * 2 : __LOT_MAX_CAPACITY;
+    lot* temp = __lot_resize(*lt, capacity);
     if (!temp) { return 1; }
     (*lt) = temp;
   }
 
-  // Grab index from the stack
-  __lot_index_t index = *__lot_stack_head(*lt);
+  // Grab index from the top of the stack
   __lot_stack_pop(*lt);
+  __lot_index_t index = *__lot_stack_head(*lt);
 
   // Increment count at node
   uint8_t* count_ref = __lot_node_ctrl(*lt, index);
@@ -70,6 +98,7 @@ void* __lot_find(lot* lt, __lot_key_t key) {
   // Decompose key into count and index
   uint8_t count = __lot_key_count(key);
   __lot_index_t index = __lot_key_index(key);
+  if (index >= lt->__capacity) { return NULL; }
 
   // Check if high bit at metadata is set & the counts match
   uint8_t node_count = *__lot_node_ctrl(lt, index);
@@ -88,6 +117,7 @@ uint8_t __lot_delete(lot* lt, __lot_key_t key) {
   // Decompose key into count and index
   uint8_t count = __lot_key_count(key);
   __lot_index_t index = __lot_key_index(key);
+  if (index >= lt->__capacity) { return 0; }
 
   // Check if high bit at metadata is set & the counts match
   uint8_t* node_count_ref = __lot_node_ctrl(lt, index);
@@ -104,47 +134,94 @@ uint8_t __lot_delete(lot* lt, __lot_key_t key) {
   return 0;
 }
 
-lot_it_t* __lot_it(lot* lt) {
+uint8_t __lot_reserve(lot** lt, size_t capacity) {
   // Error check
-  if (!lt) { return NULL; }
+  if (!lt || !(*lt)) { return 1; }
 
-  // Construct iterator
-  lot_it_t* it = malloc(sizeof(*it));
-  if (!it) { return NULL; }
-  it->__index = SIZE_MAX;
+  // Grow straight to the requested capacity
+  if (capacity <= (*lt)->__capacity) { return 0; }
+  if (capacity > __LOT_MAX_CAPACITY) { return 1; }
+  lot* temp = __lot_resize(*lt, capacity);
+  if (!temp) { return 1; }
+  (*lt) = temp;
+  return 0;
+}
+
+uint8_t __lot_shrink(lot** lt) {
+  // Error check
+  if (!lt || !(*lt)) { return 1; }
+
+  // Indices are handles, so only never used slots above the highest used one can go. A freed
+  // slot keeps its reuse count in the control byte, dropping it would revive stale handles.
+  size_t capacity = (*lt)->__capacity;
+  for (size_t index = capacity - 1; index > 0 && *__lot_node_ctrl(*lt, index) == 0; --index) { capacity--; }
+  if (capacity >= (*lt)->__capacity) { return 0; }
+  lot* temp = __lot_resize(*lt, capacity);
+  if (!temp) { return 1; }
+  (*lt) = temp;
+  return 0;
+}
+
+void __lot_iter_init(lot* lt, lot_it_t* it) {
+  // Error check
+  if (!it) { return; }
+
+  // Find first valid entry in lot
   it->__lot = lt;
+  it->__index = SIZE_MAX;
+  it->data = NULL;
+  __lot_iter_next(it);
+}
 
-  // Find first valid entry in map
-  __lot_next(&it);
+lot_it_t __lot_iter_begin(lot* lt) {
+  lot_it_t it;
+  __lot_iter_init(lt, &it);
   return it;
 }
 
-void __lot_next(lot_it_t** it) {
+void __lot_iter_next(lot_it_t* it) {
   // Error check
-  if (!it || !(*it)) { return; }
+  if (!it) { return; }
+  it->data = NULL;
+  if (!it->__lot) { return; }
 
   // Find the next valid position in the array
-  uint8_t* ctrl = NULL;
-  lot* lt = (*it)->__lot;
-  do {
-    // Increment index
-    (*it)->__index++;
-
-    // Reached the end of the array
-    if ((*it)->__index >= lt->__capacity) {
-      free(*it);
-      *it = NULL;
-      break;
-    }
-
+  lot* lt = it->__lot;
+  while (++it->__index < lt->__capacity) {
     // Evaluate control byte
-    ctrl = __lot_node_ctrl(lt, (*it)->__index);
+    uint8_t* ctrl = __lot_node_ctrl(lt, it->__index);
     if (*ctrl & 0x80) {
       // Index contains data
-      (*it)->data = __lot_node_data(lt, (*it)->__index);
+      it->key = __lot_key(*ctrl, it->__index);
+      it->data = __lot_node_data(lt, it->__index);
       break;
     }
-  } while (1);
+  }
+}
+
+lot_it_t* __lot_it(lot* lt) {
+  // Error check
+  if (!lt) { return NULL; }
 
-  return;
+  // Construct iterator
+  lot_it_t* it = __allocator_alloc(lt->__allocator, sizeof(*it));
+  if (!it) { return NULL; }
+  __lot_iter_init(lt, it);
+  if (lot_iter_done(it)) {
+    __allocator_free(lt->__allocator, it, sizeof(*it));
+    return NULL;
+  }
+  return it;
+}
+
+void __lot_next(lot_it_t** it) {
+  // Error check
+  if (!it || !(*it)) { return; }
+
+  // Free the iterator once it reaches the end of the array
+  __lot_iter_next(*it);
+  if (lot_iter_done(*it)) {
+    __allocator_free((*it)->__lot->__allocator, *it, sizeof(**it));
+    *it = NULL;
+  }
 }
\ No newline at end of file
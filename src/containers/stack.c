@@ -1,21 +1,34 @@
 #include "mars/containers/stack.h"
+#include "mars/mars_trace.h"
 
-stack* __stack_factory(size_t element_size, size_t capacity) {
-  stack* stk = malloc(offsetof(stack, __buffer) + (element_size * capacity));
+stack* __stack_factory(size_t element_size, size_t capacity, allocator* alloc) {
+  stack* stk = __allocator_alloc(alloc, offsetof(stack, __buffer) + (element_size * capacity));
   if (!stk) { return NULL; }
   stk->length = 0;
   stk->__capacity = capacity;
   stk->__element_size = element_size;
+  stk->__peak = stack_bytes(stk);
+  stk->__resizes = 0;
+  stk->__allocator = alloc;
   return stk;
 }
 
+void __stack_destroy(stack* stk) {
+  if (stk) {
+    __allocator_free(stk->__allocator, stk, stack_bytes(stk));
+  }
+}
+
 stack* __stack_resize(stack* stk, size_t new_capacity) {
-  // Create new stack & copy data to it
-  stack* new_stk = __stack_factory(stk->__element_size, new_capacity);
+  // Let the allocator move the block, elements past the new capacity are dropped
+  MARS_TRACE_BEGIN("stack_resize", new_capacity);
+  stack* new_stk = __allocator_realloc(stk->__allocator, stk, stack_bytes(stk), offsetof(stack, __buffer) + (stk->__element_size * new_capacity));
+  MARS_TRACE_END("stack_resize", new_capacity);
   if (!new_stk) { return NULL; }
-  memcpy(new_stk->__buffer, stk->__buffer, stk->__element_size * stk->length);
-  new_stk->length = stk->length;
-  free(stk);
+  new_stk->__capacity = new_capacity;
+  new_stk->__resizes++;
+  __container_peak(new_stk->__peak, stack_bytes(new_stk));
+  new_stk->length = (new_stk->length < new_capacity) ? new_stk->length : new_capacity;
   return new_stk;
 }
 
@@ -44,4 +57,29 @@ uint8_t __stack_remove(stack* stk, size_t count) {
   // Decrement length
   stk->length -= count;
   return 0;
+}
+
+uint8_t __stack_reserve(stack** stk, size_t capacity) {
+  // Error check
+  if (!stk || !(*stk)) { return 1; }
+
+  // Grow straight to the requested capacity
+  if (capacity <= (*stk)->__capacity) { return 0; }
+  stack* temp = __stack_resize(*stk, capacity);
+  if (!temp) { return 1; }
+  (*stk) = temp;
+  return 0;
+}
+
+uint8_t __stack_shrink(stack** stk) {
+  // Error check
+  if (!stk || !(*stk)) { return 1; }
+
+  // Keep room for one element so doubling still works
+  size_t capacity = ((*stk)->length > 0) ? (*stk)->length : 1;
+  if (capacity >= (*stk)->__capacity) { return 0; }
+  stack* temp = __stack_resize(*stk, capacity);
+  if (!temp) { return 1; }
+  (*stk) = temp;
+  return 0;
 }
\ No newline at end of file
@@ -1,47 +1,258 @@
 #include "mars/containers/unordered_map.h"
+#include "mars/mars_trace.h"
 
 size_t __umap_node_size(size_t element_size) {
-  size_t key_size = sizeof(__umap_key_t);
-  size_t size_max = element_size > key_size ? element_size : key_size;
-  return (element_size + key_size + (size_max - 1)) & ~(size_max - 1);
+  return (__UMAP_NODE_DATA + element_size + (__UMAP_NODE_ALIGN - 1)) & ~(size_t)(__UMAP_NODE_ALIGN - 1);
 }
 
-unordered_map* __umap_factory(size_t element_size, size_t capacity) {
-  unordered_map* umap = malloc(offsetof(unordered_map, __buffer) + capacity + (__umap_node_size(element_size) * capacity));
+/*=======================================================*/
+/* Group probing                                         */
+/* A group is __UMAP_GROUP_WIDTH consecutive control     */
+/* bytes. Matches come back as a bitmask with one bit    */
+/* (SSE2) or one byte (SWAR) per control byte.           */
+/*=======================================================*/
+#ifdef __UMAP_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#ifdef __UMAP_SSE2
+typedef uint32_t __umap_mask_t;
+#define __umap_mask_shift 0
+#define __umap_mask_top ((__umap_mask_t)1 << (__UMAP_GROUP_WIDTH - 1))
+
+static inline __umap_mask_t __umap_group_match(const uint8_t* ctrl, uint8_t h2) {
+  __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+  return (__umap_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+static inline __umap_mask_t __umap_group_match_empty(const uint8_t* ctrl) {
+  __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+  return (__umap_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)__UMAP_EMPTY)));
+}
+
+static inline __umap_mask_t __umap_group_match_free(const uint8_t* ctrl) {
+  // Empty & deleted bytes are the only ones with the high bit set
+  return (__umap_mask_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+}
+#else
+typedef uint64_t __umap_mask_t;
+#define __umap_mask_shift 3
+#define __umap_lsbs 0x0101010101010101ULL
+#define __umap_msbs 0x8080808080808080ULL
+#define __umap_mask_top ((__umap_mask_t)0x80 << 56)
+
+static inline uint64_t __umap_group_load(const uint8_t* ctrl) {
+  uint64_t group;
+  memcpy(&group, ctrl, sizeof(group));
+  #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    group = __builtin_bswap64(group);
+  #endif
+  return group;
+}
+
+static inline __umap_mask_t __umap_group_match(const uint8_t* ctrl, uint8_t h2) {
+  // Zero-byte test; may report false positives, which the key comparison filters out
+  uint64_t x = __umap_group_load(ctrl) ^ (__umap_lsbs * h2);
+  return (x - __umap_lsbs) & ~x & __umap_msbs;
+}
+
+static inline __umap_mask_t __umap_group_match_empty(const uint8_t* ctrl) {
+  // Empty is the only special byte with bit 1 clear
+  uint64_t group = __umap_group_load(ctrl);
+  return group & ~(group << 6) & __umap_msbs;
+}
+
+static inline __umap_mask_t __umap_group_match_free(const uint8_t* ctrl) {
+  return __umap_group_load(ctrl) & __umap_msbs;
+}
+#endif
+
+// Index of the lowest match in a mask
+static inline size_t __umap_mask_first(__umap_mask_t mask) {
+  #if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    #ifdef __UMAP_SSE2
+      _BitScanForward(&index, (unsigned long)mask);
+    #elif defined(_WIN64)
+      _BitScanForward64(&index, mask);
+    #else
+      if (!_BitScanForward(&index, (unsigned long)mask)) {
+        _BitScanForward(&index, (unsigned long)(mask >> 32));
+        index += 32;
+      }
+    #endif
+    return (size_t)index >> __umap_mask_shift;
+  #else
+    return (size_t)__builtin_ctzll((unsigned long long)mask) >> __umap_mask_shift;
+  #endif
+}
+
+// Number of non-matching slots before the lowest match (group width if none match)
+static inline size_t __umap_mask_trailing(__umap_mask_t mask) {
+  return (mask) ? __umap_mask_first(mask) : __UMAP_GROUP_WIDTH;
+}
+
+// Number of non-matching slots after the highest match (group width if none match)
+static inline size_t __umap_mask_leading(__umap_mask_t mask) {
+  size_t count = 0;
+  while (count < __UMAP_GROUP_WIDTH && !(mask & __umap_mask_top)) {
+    mask <<= (1 << __umap_mask_shift);
+    count++;
+  }
+  return count;
+}
+
+// Write a control byte, keeping the mirrored copy at the end of the array in sync
+static inline void __umap_set_ctrl(unordered_map* umap, size_t pos, uint8_t value) {
+  *__umap_ctrl(umap, pos) = value;
+  if (pos < __UMAP_GROUP_WIDTH) {
+    *__umap_ctrl(umap, umap->__capacity + pos) = value;
+  }
+}
+
+// Murmur3 finalizer, inlined for maps using the default hash
+static inline __umap_hash_t __umap_hash_mix(__umap_key_t key) {
+  #if defined(__UMAP_32) || defined(MARS_32)
+    key ^= key >> 16;
+    key *= 0x85EBCA6BU;
+    key ^= key >> 13;
+    key *= 0xC2B2AE35U;
+    key ^= key >> 16;
+  #else
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+  #endif
+  return (__umap_hash_t)key;
+}
+
+// Hash a key with the map's hook, skipping the indirect call for the default
+#define __umap_hash_of(u, k) (((u)->__hash == __umap_hash) ? __umap_hash_mix(k) : (u)->__hash(k))
+
+// Number of used (live or tombstoned) slots that triggers growth, always leaving one empty slot
+static inline size_t __umap_max_load(unordered_map* umap) {
+  size_t max_load = (size_t)(umap->__capacity * umap->__load_factor);
+  return (max_load < umap->__capacity) ? max_load : umap->__capacity - 1;
+}
+
+// Probe groups quadratically (triangular steps) until a group has an empty slot
+#define __umap_probe_start(u, h, pos, step) size_t pos = __umap_h1(h) & ((u)->__capacity - 1); size_t step = 0
+#define __umap_probe_next(u, pos, step) step += __UMAP_GROUP_WIDTH; pos = (pos + step) & ((u)->__capacity - 1)
+
+// Find the node holding a key, returns SIZE_MAX if it is not in the map
+static size_t __umap_find_pos(unordered_map* umap, __umap_key_t key, __umap_hash_t h) {
+  uint8_t h2 = __umap_h2(h);
+  __umap_probe_start(umap, h, pos, step);
+  while (1) {
+    const uint8_t* ctrl = __umap_ctrl(umap, pos);
+
+    // Verify the key of every slot whose control byte matches the lower byte of the hash
+    __umap_mask_t match = __umap_group_match(ctrl, h2);
+    while (match) {
+      size_t index = (pos + __umap_mask_first(match)) & (umap->__capacity - 1);
+      if (key == *(__umap_node_key(umap, index))) { return index; }
+      match &= match - 1;
+    }
+
+    // Empty slot marks the end of the bucket chain
+    if (__umap_group_match_empty(ctrl)) { return SIZE_MAX; }
+    __umap_probe_next(umap, pos, step);
+  }
+}
+
+// Find the first empty or deleted slot along a hash's probe sequence
+static size_t __umap_find_free(unordered_map* umap, __umap_hash_t h) {
+  __umap_probe_start(umap, h, pos, step);
+  while (1) {
+    __umap_mask_t match = __umap_group_match_free(__umap_ctrl(umap, pos));
+    if (match) {
+      return (pos + __umap_mask_first(match)) & (umap->__capacity - 1);
+    }
+    __umap_probe_next(umap, pos, step);
+  }
+}
+
+
+/*=======================================================*/
+/* Hash table                                            */
+/*=======================================================*/
+unordered_map* __umap_factory(size_t element_size, size_t capacity, allocator* alloc) {
+  // Capacity must be a power of two holding at least one group
+  size_t size = __UMAP_MIN_CAPACITY;
+  while (size < capacity) { size *= 2; }
+  capacity = size;
+
+  // Nodes follow the control bytes
+  size_t node_size = __umap_node_size(element_size);
+  size_t node_offset = offsetof(unordered_map, __buffer) + __umap_ctrl_bytes(capacity);
+  node_offset = (node_offset + (__UMAP_NODE_ALIGN - 1)) & ~(size_t)(__UMAP_NODE_ALIGN - 1);
+  unordered_map* umap = __allocator_alloc(alloc, node_offset + (node_size * capacity));
   if (!umap) { return NULL; }
   umap->length = 0;
   umap->__capacity = capacity;
   umap->__element_size = element_size;
+  umap->__node_size = node_size;
+  umap->__node_offset = node_offset;
   umap->__load_count = 0;
   umap->__load_factor = __UMAP_DEFAULT_LOAD;
-  memset(__umap_ctrl(umap, 0), __UMAP_EMPTY, capacity);
+  umap->__hash = __umap_hash;
+  umap->__peak = unordered_map_bytes(umap);
+  umap->__resizes = 0;
+  umap->__allocator = alloc;
+  memset(__umap_ctrl(umap, 0), __UMAP_EMPTY, __umap_ctrl_bytes(capacity));
   return umap;
 }
 
 unordered_map* __umap_resize(unordered_map* umap, size_t new_capacity) {
   // Create new map
-  unordered_map* new_umap = __umap_factory(umap->__element_size, new_capacity);
-  if (!new_umap) { return NULL; }
+  MARS_TRACE_BEGIN("umap_resize", new_capacity);
+  unordered_map* new_umap = __umap_factory(umap->__element_size, new_capacity, umap->__allocator);
+  if (!new_umap) {
+    MARS_TRACE_END("umap_resize", new_capacity);
+    return NULL;
+  }
+  new_umap->__load_factor = umap->__load_factor;
+  new_umap->__hash = umap->__hash;
+  new_umap->__resizes = umap->__resizes + 1;
+  new_umap->__peak = umap->__peak;
+  __container_peak(new_umap->__peak, unordered_map_bytes(new_umap));
 
-  // Rehash data
+  // Rehash data straight into free slots, keys are already unique
   for (size_t i = 0; i < umap->__capacity; ++i) {
     uint8_t* ctrl = __umap_ctrl(umap, i);
     if (!((*ctrl) & __UMAP_EMPTY)) {
       __umap_key_t* _key = __umap_node_key(umap, i);
-      void* _data = __umap_node_data(umap, i);
-      __umap_insert(&new_umap, *_key, _data);
+      __umap_hash_t h = __umap_hash_of(umap, *_key);
+      size_t pos = __umap_find_free(new_umap, h);
+      __umap_set_ctrl(new_umap, pos, __umap_h2(h));
+      memcpy(__umap_node(new_umap, pos), __umap_node(umap, i), umap->__node_size);
     }
   }
-
-  // Copy over attributes
-  new_umap->__load_factor = umap->__load_factor;
+  new_umap->length = umap->length;
+  new_umap->__load_count = umap->length;
 
   // Return new map
-  free(umap);
+  __umap_destroy(umap);
+  MARS_TRACE_END("umap_resize", new_capacity);
   return new_umap;
 }
 
+void __umap_destroy(unordered_map* umap) {
+  if (umap) {
+    __allocator_free(umap->__allocator, umap, unordered_map_bytes(umap));
+  }
+}
+
 __umap_hash_t __umap_hash(__umap_key_t key) {
+  return __umap_hash_mix(key);
+}
+
+__umap_hash_t __umap_hash_fnv(__umap_key_t key) {
   // Hash using basic FNV-1a implementation
   __umap_hash_t hash = __fnv_offset;
   for (size_t i = 0; i < sizeof(__umap_key_t); ++i) {
@@ -51,43 +262,63 @@ __umap_hash_t __umap_hash(__umap_key_t key) {
   return hash;
 }
 
+__umap_hash_t __umap_hash_fib(__umap_key_t key) {
+  return (__umap_hash_t)(key * __fib_multiplier);
+}
+
+__umap_hash_t __umap_hash_identity(__umap_key_t key) {
+  return (__umap_hash_t)key;
+}
+
+void __umap_set_hash(unordered_map* umap, __umap_hash_fn hash) {
+  // Error check
+  if (!umap) { return; }
+
+  // Existing nodes have to move to their new probe sequences
+  umap->__hash = (hash) ? hash : __umap_hash;
+  if (umap->length > 0) { __umap_rehash(umap); }
+}
+
 uint8_t __umap_insert(unordered_map** umap, __umap_key_t key, void* data) {
   // Error check
   if (!umap || !(*umap)) { return 1; }
 
-  // Resize if needed
-  if ((*umap)->__load_count / (float)(*umap)->__capacity >= (*umap)->__load_factor) {
-    unordered_map* temp = __umap_resize(*umap, (*umap)->__capacity * 2);
-    if (!temp) { return 1; }
-    (*umap) = temp;
+  // Overwrite the data of an existing key
+  __umap_hash_t h = __umap_hash_of(*umap, key);
+  size_t pos = __umap_find_pos(*umap, key, h);
+  if (pos != SIZE_MAX) {
+    memcpy(__umap_node_data(*umap, pos), data, (*umap)->__element_size);
+    return 0;
   }
 
-  // Hash the key
-  __umap_hash_t h = __umap_hash(key);
-  size_t pos = __umap_h1(h) & ((*umap)->__capacity - 1);
-
-  // Linear probe to find an empty bucket
-  while (1) {
-    uint8_t* ctrl = __umap_ctrl(*umap, pos);
-    // Space is empty if high bit is 1
-    if ((*ctrl) & __UMAP_EMPTY) {
-      // Save lower 8 bits of hash to the control block
-      __umap_hash_t h2 = __umap_h2(h);
-      memcpy(ctrl, &h2, 1);
-
-      // Save the key to the start of the node block
-      memcpy(__umap_node_key(*umap, pos), &key, sizeof(key));
-
-      // Save the data to the end of the node block, aligned by the larger data type
-      memcpy(__umap_node_data(*umap, pos), data, (*umap)->__element_size);
-      break;
+  // Reusing a deleted slot never needs more room
+  pos = __umap_find_free(*umap, h);
+  size_t max_load = __umap_max_load(*umap);
+  if (*__umap_ctrl(*umap, pos) == __UMAP_EMPTY && (*umap)->__load_count >= max_load) {
+    if ((*umap)->length < max_load - (max_load / 8)) {
+      // Enough of the load is tombstones, clear them out without growing
+      __umap_rehash(*umap);
     }
     else {
-      pos = (pos + 1) & ((*umap)->__capacity - 1);
+      unordered_map* temp = __umap_resize(*umap, (*umap)->__capacity * 2);
+      if (!temp) { return 1; }
+      (*umap) = temp;
     }
+    pos = __umap_find_free(*umap, h);
   }
+  if (*__umap_ctrl(*umap, pos) == __UMAP_EMPTY) {
+    (*umap)->__load_count++;
+  }
+
+  // Save lower bits of hash to the control block
+  __umap_set_ctrl(*umap, pos, __umap_h2(h));
+
+  // Save the key to the start of the node block
+  memcpy(__umap_node_key(*umap, pos), &key, sizeof(key));
+
+  // Save the data to the end of the node block, aligned by the larger data type
+  memcpy(__umap_node_data(*umap, pos), data, (*umap)->__element_size);
   (*umap)->length++;
-  (*umap)->__load_count++;
   return 0;
 }
 
@@ -95,106 +326,200 @@ uint8_t __umap_delete(unordered_map* umap, __umap_key_t key) {
   // Error check
   if (!umap) { return 1; }
 
-  // Hash key again
-  __umap_hash_t h = __umap_hash(key);
-  size_t pos = __umap_h1(h) & (umap->__capacity - 1);
+  // Find key
+  size_t pos = __umap_find_pos(umap, key, __umap_hash_of(umap, key));
+  if (pos == SIZE_MAX) { return 0; }
 
-  // Linear probe to find key
-  while (1) {
-    uint8_t* ctrl = __umap_ctrl(umap, pos);
-    // Check if this control byte matches lower byte of hash
-    __umap_hash_t h2 = __umap_h2(h);
-    if (*ctrl == h2) {
-      // Verify key at this pos matches
-      if (key == *(__umap_node_key(umap, pos))) {
-        memset(ctrl, __UMAP_DELETED, 1);
-        umap->length--;
-        return 0;
-      }
+  // If no group containing this slot was ever full, no probe sequence continues past it
+  // and it can go straight back to empty instead of becoming a tombstone
+  size_t mask = umap->__capacity - 1;
+  __umap_mask_t empty_before = __umap_group_match_empty(__umap_ctrl(umap, (pos - __UMAP_GROUP_WIDTH) & mask));
+  __umap_mask_t empty_after = __umap_group_match_empty(__umap_ctrl(umap, pos));
+  if (empty_before && empty_after && (__umap_mask_leading(empty_before) + __umap_mask_trailing(empty_after)) < __UMAP_GROUP_WIDTH) {
+    __umap_set_ctrl(umap, pos, __UMAP_EMPTY);
+    umap->__load_count--;
+  }
+  else {
+    __umap_set_ctrl(umap, pos, __UMAP_DELETED);
+  }
+  umap->length--;
+  return 0;
+}
+
+// Swap two nodes without allocating
+static void __umap_swap_nodes(uint8_t* a, uint8_t* b, size_t size) {
+  uint8_t temp[64];
+  while (size > 0) {
+    size_t chunk = size < sizeof(temp) ? size : sizeof(temp);
+    memcpy(temp, a, chunk);
+    memcpy(a, b, chunk);
+    memcpy(b, temp, chunk);
+    a += chunk;
+    b += chunk;
+    size -= chunk;
+  }
+}
+
+void __umap_rehash(unordered_map* umap) {
+  // Error check
+  if (!umap) { return; }
+
+  // Tombstones become empty, live slots become deleted (meaning "not yet placed")
+  size_t mask = umap->__capacity - 1;
+  for (size_t i = 0; i < umap->__capacity; ++i) {
+    uint8_t* ctrl = __umap_ctrl(umap, i);
+    *ctrl = ((*ctrl) & __UMAP_EMPTY) ? __UMAP_EMPTY : __UMAP_DELETED;
+  }
+  memcpy(__umap_ctrl(umap, umap->__capacity), __umap_ctrl(umap, 0), __UMAP_GROUP_WIDTH);
+
+  // Place every live node at the first free slot of its probe sequence
+  for (size_t i = 0; i < umap->__capacity; ++i) {
+    if (*__umap_ctrl(umap, i) != __UMAP_DELETED) { continue; }
+    __umap_hash_t h = __umap_hash_of(umap, *__umap_node_key(umap, i));
+    size_t start = __umap_h1(h) & mask;
+    size_t target = __umap_find_free(umap, h);
+
+    // Already in the right group of its probe sequence
+    if ((((target - start) & mask) / __UMAP_GROUP_WIDTH) == (((i - start) & mask) / __UMAP_GROUP_WIDTH)) {
+      __umap_set_ctrl(umap, i, __umap_h2(h));
+      continue;
     }
-    else if (*ctrl == __UMAP_EMPTY) {
-      // Empty slot marks the end of the bucket chain
-      return 0;
+
+    if (*__umap_ctrl(umap, target) == __UMAP_EMPTY) {
+      // Move into the empty slot
+      __umap_set_ctrl(umap, target, __umap_h2(h));
+      memcpy(__umap_node(umap, target), __umap_node(umap, i), umap->__node_size);
+      __umap_set_ctrl(umap, i, __UMAP_EMPTY);
     }
     else {
-      // Look at next control byte
-      pos = (pos + 1) & (umap->__capacity - 1);
+      // Target holds a node that is not placed yet, swap & place the one that landed here
+      __umap_set_ctrl(umap, target, __umap_h2(h));
+      __umap_swap_nodes(__umap_node(umap, target), __umap_node(umap, i), umap->__node_size);
+      --i;
     }
   }
+  umap->__load_count = umap->length;
 }
 
 void* __umap_find(unordered_map* umap, __umap_key_t key) {
   // Error check
   if (!umap) { return NULL; }
 
-  // Hash key again
-  __umap_hash_t h = __umap_hash(key);
-  size_t pos = __umap_h1(h) & (umap->__capacity - 1);
+  // Find key
+  size_t pos = __umap_find_pos(umap, key, __umap_hash_of(umap, key));
+  return (pos != SIZE_MAX) ? __umap_node_data(umap, pos) : NULL;
+}
 
-  // Linear probe to find key
+// Smallest capacity whose load limit holds the given number of keys
+static size_t __umap_capacity_for(unordered_map* umap, size_t count) {
+  size_t capacity = __UMAP_MIN_CAPACITY;
   while (1) {
-    uint8_t* ctrl = __umap_ctrl(umap, pos);
-    // Check if this control byte matches lower byte of hash
-    __umap_hash_t h2 = __umap_h2(h);
-    if (*ctrl == h2) {
-      // Verify key at this pos matches
-      if (key == *(__umap_node_key(umap, pos))) {
-        return __umap_node_data(umap, pos);
-      }
-    }
-    else if (*ctrl == __UMAP_EMPTY) {
-      // Empty slot marks the end of the bucket chain
-      return NULL;
-    }
-    else {
-      // Look at next control byte
-      pos = (pos + 1) & (umap->__capacity - 1);
-    }
+    size_t max_load = (size_t)(capacity * umap->__load_factor);
+    max_load = (max_load < capacity) ? max_load : capacity - 1;
+    if (max_load >= count) { return capacity; }
+    capacity *= 2;
   }
 }
 
-umap_it_t* __umap_it(unordered_map* umap) {
+uint8_t __umap_reserve(unordered_map** umap, size_t count) {
   // Error check
-  if (!umap) { return NULL; }
+  if (!umap || !(*umap)) { return 1; }
+
+  // Grow once instead of doubling repeatedly
+  size_t capacity = __umap_capacity_for(*umap, count);
+  if (capacity <= (*umap)->__capacity) { return 0; }
+  unordered_map* temp = __umap_resize(*umap, capacity);
+  if (!temp) { return 1; }
+  (*umap) = temp;
+  return 0;
+}
+
+uint8_t __umap_shrink(unordered_map** umap) {
+  // Error check
+  if (!umap || !(*umap)) { return 1; }
+
+  // Rebuild smaller, or just clear out tombstones if the size is already right
+  size_t capacity = __umap_capacity_for(*umap, (*umap)->length);
+  if (capacity >= (*umap)->__capacity) {
+    if ((*umap)->__load_count > (*umap)->length) { __umap_rehash(*umap); }
+    return 0;
+  }
+  unordered_map* temp = __umap_resize(*umap, capacity);
+  if (!temp) { return 1; }
+  (*umap) = temp;
+  return 0;
+}
+
+void __umap_clear(unordered_map* umap) {
+  // Error check
+  if (!umap) { return; }
+
+  // Mark every slot empty
+  memset(__umap_ctrl(umap, 0), __UMAP_EMPTY, __umap_ctrl_bytes(umap->__capacity));
+  umap->length = 0;
+  umap->__load_count = 0;
+}
+
+void __umap_iter_init(unordered_map* umap, umap_it_t* it) {
+  // Error check
+  if (!it) { return; }
 
-  // Construct iterator
-  umap_it_t* it = malloc(sizeof(*it));
-  if (!it) { return NULL; }
-  it->__index = SIZE_MAX;
-  it->__umap = umap;
-  
   // Find first valid entry in map
-  __umap_next(&it);
+  it->__umap = umap;
+  it->__index = SIZE_MAX;
+  it->data = NULL;
+  __umap_iter_next(it);
+}
+
+umap_it_t __umap_iter_begin(unordered_map* umap) {
+  umap_it_t it;
+  __umap_iter_init(umap, &it);
   return it;
 }
 
-void __umap_next(umap_it_t** it) {
+void __umap_iter_next(umap_it_t* it) {
   // Error check
-  if (!it | !(*it)) { return; }
+  if (!it) { return; }
+  it->data = NULL;
+  if (!it->__umap) { return; }
 
   // Find the next valid position in the array
-  uint8_t* ctrl = NULL;
-  unordered_map* umap = (*it)->__umap;
-  do {
-    // Increment index
-    (*it)->__index++;
-
-    // Reached the end of the array
-    if ((*it)->__index >= umap->__capacity) {
-      free(*it);
-      *it = NULL;
-      break;
-    }
-
+  unordered_map* umap = it->__umap;
+  while (++it->__index < umap->__capacity) {
     // Evaluate control byte
-    ctrl = __umap_ctrl(umap, (*it)->__index);
+    uint8_t* ctrl = __umap_ctrl(umap, it->__index);
     if (!(*ctrl & __UMAP_EMPTY)) {
       // Index contains data
-      (*it)->key = *__umap_node_key(umap, (*it)->__index);
-      (*it)->data = __umap_node_data(umap, (*it)->__index);
+      it->key = *__umap_node_key(umap, it->__index);
+      it->data = __umap_node_data(umap, it->__index);
       break;
     }
-  } while(1);
+  }
+}
+
+umap_it_t* __umap_it(unordered_map* umap) {
+  // Error check
+  if (!umap) { return NULL; }
+
+  // Construct iterator
+  umap_it_t* it = __allocator_alloc(umap->__allocator, sizeof(*it));
+  if (!it) { return NULL; }
+  __umap_iter_init(umap, it);
+  if (unordered_map_iter_done(it)) {
+    __allocator_free(umap->__allocator, it, sizeof(*it));
+    return NULL;
+  }
+  return it;
+}
 
-  return;
+void __umap_next(umap_it_t** it) {
+  // Error check
+  if (!it || !(*it)) { return; }
+
+  // Free the iterator once it reaches the end of the array
+  __umap_iter_next(*it);
+  if (unordered_map_iter_done(*it)) {
+    __allocator_free((*it)->__umap->__allocator, *it, sizeof(**it));
+    *it = NULL;
+  }
 }
\ No newline at end of file
@@ -1,21 +1,34 @@
 #include "mars/containers/vector.h"
+#include "mars/mars_trace.h"
 
-vector* __vec_factory(size_t element_size, size_t capacity) {
-  vector* vec = malloc(offsetof(vector, __buffer) + (element_size * capacity));
+vector* __vec_factory(size_t element_size, size_t capacity, allocator* alloc) {
+  vector* vec = __allocator_alloc(alloc, offsetof(vector, __buffer) + (element_size * capacity));
   if (!vec) { return NULL; }
   vec->length = 0;
   vec->__capacity = capacity;
   vec->__element_size = element_size;
+  vec->__peak = vector_bytes(vec);
+  vec->__resizes = 0;
+  vec->__allocator = alloc;
   return vec;
 }
 
+void __vec_destroy(vector* vec) {
+  if (vec) {
+    __allocator_free(vec->__allocator, vec, vector_bytes(vec));
+  }
+}
+
 vector* __vec_resize(vector* vec, size_t new_capacity) {
-  // Create new vector & copy data to it
-  vector* new_vec = __vec_factory(vec->__element_size, new_capacity);
+  // Let the allocator move the block, elements past the new capacity are dropped
+  MARS_TRACE_BEGIN("vector_resize", new_capacity);
+  vector* new_vec = __allocator_realloc(vec->__allocator, vec, vector_bytes(vec), offsetof(vector, __buffer) + (vec->__element_size * new_capacity));
+  MARS_TRACE_END("vector_resize", new_capacity);
   if (!new_vec) { return NULL; }
-  memcpy(new_vec->__buffer, vec->__buffer, vec->__element_size * vec->length);
-  new_vec->length = vec->length;
-  free(vec);
+  new_vec->__capacity = new_capacity;
+  new_vec->__resizes++;
+  __container_peak(new_vec->__peak, vector_bytes(new_vec));
+  new_vec->length = (new_vec->length < new_capacity) ? new_vec->length : new_capacity;
   return new_vec;
 }
 
@@ -49,7 +62,7 @@ uint8_t __vec_insert(vector** vec, size_t index, void* data) {
 uint8_t __vec_remove(vector* vec, size_t index, size_t count) {
   // Error check
   if (!vec) { return 1; }
-  if ((index + count) >= vec->length) { return 1; }
+  if ((index + count) > vec->length) { return 1; }
   
   // Shift over elements
   if (index < vec->length) {
@@ -62,4 +75,46 @@ uint8_t __vec_remove(vector* vec, size_t index, size_t count) {
   // Decrement length
   vec->length -= count;
   return 0;
+}
+
+uint8_t __vec_reserve(vector** vec, size_t capacity) {
+  // Error check
+  if (!vec || !(*vec)) { return 1; }
+
+  // Grow straight to the requested capacity
+  if (capacity <= (*vec)->__capacity) { return 0; }
+  vector* temp = __vec_resize(*vec, capacity);
+  if (!temp) { return 1; }
+  (*vec) = temp;
+  return 0;
+}
+
+uint8_t __vec_shrink(vector** vec) {
+  // Error check
+  if (!vec || !(*vec)) { return 1; }
+
+  // Keep room for one element so doubling still works
+  size_t capacity = ((*vec)->length > 0) ? (*vec)->length : 1;
+  if (capacity >= (*vec)->__capacity) { return 0; }
+  vector* temp = __vec_resize(*vec, capacity);
+  if (!temp) { return 1; }
+  (*vec) = temp;
+  return 0;
+}
+
+void* __vec_emplace(vector** vec) {
+  // Error check
+  if (!vec || !(*vec)) { return NULL; }
+
+  // Resize container
+  if ((*vec)->length >= (*vec)->__capacity) {
+    vector* temp = __vec_resize(*vec, (*vec)->__capacity * 2);
+    if (!temp) { return NULL; }
+    (*vec) = temp;
+  }
+
+  // Hand back the uninitialized slot at the end
+  void* dest = (void*)(&(*vec)->__buffer[0] + (*vec)->length * (*vec)->__element_size);
+  (*vec)->length++;
+  return dest;
 }
\ No newline at end of file
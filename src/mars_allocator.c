@@ -0,0 +1,329 @@
+#ifndef MARS_EXPORTS
+  #define MARS_EXPORTS
+#endif
+#include "mars/mars_core.h"
+
+/*=======================================================*/
+/* Definitions                                           */
+/*=======================================================*/
+#define allocator_align(x) (((x) + (MARS_ALLOCATOR_ALIGN - 1)) & ~(size_t)(MARS_ALLOCATOR_ALIGN - 1))
+#define allocator_header allocator_align(sizeof(void*) + sizeof(size_t))   // Link & size kept in front of slabs & overflow blocks
+
+// Change the bytes handed out by the difference between two sizes, raising the peak if needed
+static void allocator_stats_resize(AllocatorStats* stats, size_t old_size, size_t new_size) {
+  size_t bytes = mars_atomic_add(&stats->bytes, new_size - old_size);
+  size_t peak = mars_atomic_load(&stats->peak);
+  while (bytes > peak && !mars_atomic_cas(&stats->peak, peak, bytes)) {
+    peak = mars_atomic_load(&stats->peak);
+  }
+}
+
+// Count a block handed out
+static void allocator_stats_alloc(AllocatorStats* stats, size_t size) {
+  mars_atomic_add(&stats->allocs, 1);
+  allocator_stats_resize(stats, 0, size);
+}
+
+// Count a block given back
+static void allocator_stats_free(AllocatorStats* stats, size_t size) {
+  mars_atomic_add(&stats->frees, 1);
+  mars_atomic_add(&stats->bytes, (size_t)0 - size);
+}
+
+// Give the allocations that didn't fit in an arena's block back to its parent
+static void frame_arena_drop_overflow(FrameArena* arena) {
+  while (arena->overflow) {
+    uint8_t* block = arena->overflow;
+    arena->overflow = *(void**)block;
+    allocator_free(arena->parent, block, *(size_t*)(block + sizeof(void*)));
+  }
+  arena->stats.reserved -= arena->overflow_bytes;
+  arena->overflow_bytes = 0;
+}
+
+AllocatorStats allocator_stats_get(AllocatorStats* stats) {
+  AllocatorStats copy = { 0 };
+  if (stats) {
+    copy.allocs = mars_atomic_load(&stats->allocs);
+    copy.frees = mars_atomic_load(&stats->frees);
+    copy.bytes = mars_atomic_load(&stats->bytes);
+    copy.peak = mars_atomic_load(&stats->peak);
+    copy.reserved = mars_atomic_load(&stats->reserved);
+  }
+  return copy;
+}
+
+
+/*=======================================================*/
+/* Heap                                                  */
+/*=======================================================*/
+
+static void* heap_alloc(void* user, size_t size) {
+  HeapAllocator* heap = user;
+  void* ptr = malloc(size);
+  if (ptr) {
+    allocator_stats_alloc(&heap->stats, size);
+    mars_atomic_add(&heap->stats.reserved, size);
+  }
+  return ptr;
+}
+
+static void* heap_realloc(void* user, void* ptr, size_t old_size, size_t new_size) {
+  HeapAllocator* heap = user;
+  if (!ptr) { return heap_alloc(user, new_size); }
+  void* new_ptr = realloc(ptr, new_size);
+  if (new_ptr) {
+    allocator_stats_resize(&heap->stats, old_size, new_size);
+    mars_atomic_add(&heap->stats.reserved, new_size - old_size);
+  }
+  return new_ptr;
+}
+
+static void heap_free(void* user, void* ptr, size_t size) {
+  HeapAllocator* heap = user;
+  free(ptr);
+  allocator_stats_free(&heap->stats, size);
+  mars_atomic_add(&heap->stats.reserved, (size_t)0 - size);
+}
+
+void heap_allocator_init(HeapAllocator* heap) {
+  // Error check
+  if (!heap) { return; }
+
+  // Assign default values
+  AllocatorStats stats = { 0 };
+  heap->stats = stats;
+  heap->base.alloc = heap_alloc;
+  heap->base.realloc = heap_realloc;
+  heap->base.free = heap_free;
+  heap->base.user = heap;
+}
+
+
+/*=======================================================*/
+/* Pool                                                  */
+/*=======================================================*/
+
+// Take a slab from the parent and put all of its blocks on the free list
+static uint8_t pool_grow(PoolAllocator* pool) {
+  size_t size = allocator_header + (pool->block_size * pool->slab_blocks);
+  uint8_t* slab = allocator_alloc(pool->parent, size);
+  if (!slab) { return 1; }
+  *(void**)slab = pool->slabs;
+  pool->slabs = slab;
+  for (size_t i = pool->slab_blocks; i > 0; --i) {
+    void** block = (void**)(slab + allocator_header + (pool->block_size * (i - 1)));
+    *block = pool->free_list;
+    pool->free_list = block;
+  }
+  pool->stats.reserved += size;
+  return 0;
+}
+
+static void* pool_alloc(void* user, size_t size) {
+  PoolAllocator* pool = user;
+  void* ptr = NULL;
+  if (size > pool->block_size) {
+    // Too large for a block
+    ptr = allocator_alloc(pool->parent, size);
+    if (!ptr) { return NULL; }
+    pool->stats.reserved += size;
+  }
+  else {
+    // Pop a free block
+    if (!pool->free_list && pool_grow(pool) > 0) { return NULL; }
+    ptr = pool->free_list;
+    pool->free_list = *(void**)ptr;
+  }
+  allocator_stats_alloc(&pool->stats, size);
+  return ptr;
+}
+
+static void pool_free(void* user, void* ptr, size_t size) {
+  PoolAllocator* pool = user;
+  if (size > pool->block_size) {
+    allocator_free(pool->parent, ptr, size);
+    pool->stats.reserved -= size;
+  }
+  else {
+    *(void**)ptr = pool->free_list;
+    pool->free_list = ptr;
+  }
+  allocator_stats_free(&pool->stats, size);
+}
+
+static void* pool_realloc(void* user, void* ptr, size_t old_size, size_t new_size) {
+  PoolAllocator* pool = user;
+  if (!ptr) { return pool_alloc(user, new_size); }
+
+  // Sizes that still fit in a block keep it
+  if (old_size <= pool->block_size && new_size <= pool->block_size) {
+    allocator_stats_resize(&pool->stats, old_size, new_size);
+    return ptr;
+  }
+
+  // Move between a block and the parent
+  void* new_ptr = pool_alloc(user, new_size);
+  if (!new_ptr) { return NULL; }
+  memcpy(new_ptr, ptr, (old_size < new_size) ? old_size : new_size);
+  pool_free(user, ptr, old_size);
+  return new_ptr;
+}
+
+PoolAllocator* pool_allocator_create(allocator* parent, size_t block_size, size_t slab_blocks) {
+  // Error check
+  if (block_size == 0 || slab_blocks == 0) {
+    mars_dlog(MARS_VERB_ERROR, "[pool_allocator_create] Blocks and slabs must not be empty!\n");
+    return NULL;
+  }
+
+  // Assign default values
+  PoolAllocator* pool = allocator_alloc(parent, sizeof(*pool));
+  if (!pool) {
+    mars_dlog(MARS_VERB_ERROR, "[pool_allocator_create] Allocation failed!\n");
+    return NULL;
+  }
+  AllocatorStats stats = { 0 };
+  pool->stats = stats;
+  pool->base.alloc = pool_alloc;
+  pool->base.realloc = pool_realloc;
+  pool->base.free = pool_free;
+  pool->base.user = pool;
+  pool->parent = parent;
+  pool->block_size = allocator_align(block_size);
+  pool->slab_blocks = slab_blocks;
+  pool->free_list = NULL;
+  pool->slabs = NULL;
+  return pool;
+}
+
+void pool_allocator_destroy(PoolAllocator* pool) {
+  if (pool) {
+    size_t size = allocator_header + (pool->block_size * pool->slab_blocks);
+    while (pool->slabs) {
+      void* slab = pool->slabs;
+      pool->slabs = *(void**)slab;
+      allocator_free(pool->parent, slab, size);
+    }
+    allocator_free(pool->parent, pool, sizeof(*pool));
+  }
+}
+
+
+/*=======================================================*/
+/* Frame arena                                           */
+/*=======================================================*/
+
+static void* frame_arena_alloc(void* user, size_t size) {
+  FrameArena* arena = user;
+  size_t offset = allocator_align(arena->used);
+  void* ptr = NULL;
+  if (size <= arena->capacity && offset <= arena->capacity - size) {
+    // Bump
+    ptr = arena->block + offset;
+    arena->last = offset;
+    arena->used = offset + size;
+  }
+  else {
+    // Keep allocations that don't fit on the side until the next reset
+    uint8_t* block = allocator_alloc(arena->parent, allocator_header + size);
+    if (!block) { return NULL; }
+    *(void**)block = arena->overflow;
+    *(size_t*)(block + sizeof(void*)) = allocator_header + size;
+    arena->overflow = block;
+    arena->overflow_bytes += allocator_header + size;
+    arena->stats.reserved += allocator_header + size;
+    ptr = block + allocator_header;
+  }
+  allocator_stats_alloc(&arena->stats, size);
+  return ptr;
+}
+
+static void frame_arena_free(void* user, void* ptr, size_t size) {
+  FrameArena* arena = user;
+  allocator_stats_free(&arena->stats, size);
+}
+
+static void* frame_arena_realloc(void* user, void* ptr, size_t old_size, size_t new_size) {
+  FrameArena* arena = user;
+  if (!ptr) { return frame_arena_alloc(user, new_size); }
+
+  // The most recent allocation can grow or shrink in place
+  if ((uint8_t*)ptr == arena->block + arena->last && arena->last + old_size == arena->used && new_size <= arena->capacity - arena->last) {
+    arena->used = arena->last + new_size;
+    allocator_stats_resize(&arena->stats, old_size, new_size);
+    return ptr;
+  }
+  if (new_size <= old_size) {
+    allocator_stats_resize(&arena->stats, old_size, new_size);
+    return ptr;
+  }
+
+  // Copy to a new allocation
+  void* new_ptr = frame_arena_alloc(user, new_size);
+  if (!new_ptr) { return NULL; }
+  memcpy(new_ptr, ptr, old_size);
+  frame_arena_free(user, ptr, old_size);
+  return new_ptr;
+}
+
+FrameArena* frame_arena_create(allocator* parent, size_t capacity) {
+  // Assign default values
+  FrameArena* arena = allocator_alloc(parent, sizeof(*arena));
+  if (!arena) {
+    mars_dlog(MARS_VERB_ERROR, "[frame_arena_create] Allocation failed!\n");
+    return NULL;
+  }
+  AllocatorStats stats = { 0 };
+  arena->stats = stats;
+  arena->base.alloc = frame_arena_alloc;
+  arena->base.realloc = frame_arena_realloc;
+  arena->base.free = frame_arena_free;
+  arena->base.user = arena;
+  arena->parent = parent;
+  arena->capacity = allocator_align(capacity);
+  arena->used = 0;
+  arena->last = 0;
+  arena->overflow = NULL;
+  arena->overflow_bytes = 0;
+  arena->block = (arena->capacity > 0) ? allocator_alloc(parent, arena->capacity) : NULL;
+  if (arena->capacity > 0 && !arena->block) {
+    mars_dlog(MARS_VERB_ERROR, "[frame_arena_create] Allocation failed!\n");
+    allocator_free(parent, arena, sizeof(*arena));
+    return NULL;
+  }
+  arena->stats.reserved = arena->capacity;
+  return arena;
+}
+
+uint8_t frame_arena_reset(FrameArena* arena) {
+  // Error check
+  if (!arena) { return 1; }
+
+  // Drop the overflow
+  size_t needed = arena->used + arena->overflow_bytes;
+  frame_arena_drop_overflow(arena);
+  arena->used = 0;
+  arena->last = 0;
+  arena->stats.bytes = 0;
+
+  // Grow the block to hold everything the last frame allocated
+  if (needed > arena->capacity) {
+    size_t capacity = allocator_align(needed);
+    uint8_t* block = allocator_alloc(arena->parent, capacity);
+    if (!block) { return 1; }
+    allocator_free(arena->parent, arena->block, arena->capacity);
+    arena->stats.reserved += capacity - arena->capacity;
+    arena->block = block;
+    arena->capacity = capacity;
+  }
+  return 0;
+}
+
+void frame_arena_destroy(FrameArena* arena) {
+  if (arena) {
+    frame_arena_drop_overflow(arena);
+    allocator_free(arena->parent, arena->block, arena->capacity);
+    allocator_free(arena->parent, arena, sizeof(*arena));
+  }
+}
\ No newline at end of file
@@ -0,0 +1,267 @@
+#ifndef MARS_EXPORTS
+  #define MARS_EXPORTS
+#endif
+#include "mars/mars_core.h"
+
+/*=======================================================*/
+/* Definitions                                           */
+/*=======================================================*/
+#define archetype_align(x) (((x) + (MARS_ARCHETYPE_ALIGN - 1)) & ~(size_t)(MARS_ARCHETYPE_ALIGN - 1))
+
+// Number of set bits in a signature
+static inline size_t archetype_popcount(signature_t signature) {
+  size_t count = 0;
+  while (signature) {
+    signature &= signature - 1;
+    count++;
+  }
+  return count;
+}
+
+// Bytes needed for a chunk of the given number of rows, filling in the column offsets
+static size_t archetype_layout(Archetype* archetype, size_t rows) {
+  size_t size = archetype_align(sizeof(mars_id_t) * rows);
+  size_t* offsets = vector_data(archetype->offsets);
+  System** systems = vector_data(archetype->systems);
+  for (size_t i = 0; i < archetype->systems->length; ++i) {
+    offsets[i] = size;
+    size += archetype_align(systems[i]->component_size * rows);
+  }
+  return size;
+}
+
+
+/*=======================================================*/
+/* Archetype                                             */
+/*=======================================================*/
+
+Archetype* archetype_create(signature_t signature, void** systems, size_t count, allocator* alloc, allocator* chunk_alloc) {
+  // Assign default values
+  Archetype* archetype = allocator_alloc(alloc, sizeof(*archetype));
+  if (!archetype) { return NULL; }
+  archetype->signature = signature;
+  archetype->allocator = alloc;
+  archetype->chunk_allocator = chunk_alloc;
+  archetype->systems = vector_create_alloc(System*, alloc);
+  archetype->offsets = vector_create_alloc(size_t, alloc);
+  archetype->chunks = vector_create_alloc(void*, alloc);
+  archetype->length = 0;
+  if (!archetype->systems || !archetype->offsets || !archetype->chunks) {
+    archetype_destroy(archetype);
+    return NULL;
+  }
+
+  // One column per system
+  size_t row_size = sizeof(mars_id_t);
+  for (size_t i = 0; i < count; ++i) {
+    size_t offset = 0;
+    if (vector_push_back(archetype->systems, &systems[i]) > 0 || vector_push_back(archetype->offsets, &offset) > 0) {
+      archetype_destroy(archetype);
+      return NULL;
+    }
+    row_size += ((System*)systems[i])->component_size;
+  }
+
+  // Fit as many rows as possible in a chunk, accounting for column padding
+  size_t rows = MARS_ARCHETYPE_CHUNK / row_size;
+  rows = (rows > 0) ? rows : 1;
+  while (rows > 1 && archetype_layout(archetype, rows) > MARS_ARCHETYPE_CHUNK) { rows--; }
+  archetype->chunk_capacity = rows;
+  archetype->chunk_size = archetype_layout(archetype, rows);
+  return archetype;
+}
+
+size_t archetype_push(Archetype* archetype, mars_id_t entity_id) {
+  // Error check
+  if (!archetype) { return SIZE_MAX; }
+
+  // Start a new chunk once the last one is full
+  size_t row = archetype->length;
+  size_t chunk = row / archetype->chunk_capacity;
+  if (chunk >= archetype->chunks->length) {
+    void* block = allocator_alloc(archetype->chunk_allocator, archetype->chunk_size);
+    if (!block) { return SIZE_MAX; }
+    if (vector_push_back(archetype->chunks, &block) > 0) {
+      allocator_free(archetype->chunk_allocator, block, archetype->chunk_size);
+      return SIZE_MAX;
+    }
+  }
+
+  // Claim the row
+  uint8_t* base = *(uint8_t**)vector_at(archetype->chunks, chunk);
+  ((mars_id_t*)base)[row % archetype->chunk_capacity] = entity_id;
+  archetype->length++;
+  return row;
+}
+
+uint8_t archetype_reserve(Archetype* archetype, size_t rows) {
+  // Error check
+  if (!archetype) { return 1; }
+
+  // Allocate every chunk the rows will need
+  size_t chunks = (rows + archetype->chunk_capacity - 1) / archetype->chunk_capacity;
+  if (vector_reserve(archetype->chunks, chunks) > 0) { return 1; }
+  while (archetype->chunks->length < chunks) {
+    void* block = allocator_alloc(archetype->chunk_allocator, archetype->chunk_size);
+    if (!block) { return 1; }
+    vector_push_back(archetype->chunks, &block);
+  }
+  return 0;
+}
+
+void archetype_shrink_to_fit(Archetype* archetype) {
+  // Error check
+  if (!archetype) { return; }
+
+  // Keep only the chunks holding rows
+  size_t chunks = (archetype->length + archetype->chunk_capacity - 1) / archetype->chunk_capacity;
+  while (archetype->chunks->length > chunks) {
+    size_t last = archetype->chunks->length - 1;
+    allocator_free(archetype->chunk_allocator, vector_get(archetype->chunks, last, void*), archetype->chunk_size);
+    vector_pop_back(archetype->chunks);
+  }
+  vector_shrink_to_fit(archetype->chunks);
+}
+
+mars_id_t archetype_remove(Archetype* archetype, size_t row) {
+  // Error check
+  if (!archetype || row >= archetype->length) { return ID_NULL; }
+
+  // Move the last row into the hole
+  size_t last = --archetype->length;
+  if (row == last) { return ID_NULL; }
+  uint8_t* dest = *(uint8_t**)vector_at(archetype->chunks, row / archetype->chunk_capacity);
+  uint8_t* src = *(uint8_t**)vector_at(archetype->chunks, last / archetype->chunk_capacity);
+  size_t dest_row = row % archetype->chunk_capacity;
+  size_t src_row = last % archetype->chunk_capacity;
+  mars_id_t moved_id = ((mars_id_t*)src)[src_row];
+  ((mars_id_t*)dest)[dest_row] = moved_id;
+  size_t* offsets = vector_data(archetype->offsets);
+  System** systems = vector_data(archetype->systems);
+  for (size_t i = 0; i < archetype->systems->length; ++i) {
+    size_t size = systems[i]->component_size;
+    memcpy(dest + offsets[i] + (dest_row * size), src + offsets[i] + (src_row * size), size);
+  }
+  return moved_id;
+}
+
+void* archetype_get(Archetype* archetype, size_t column, size_t row) {
+  // Error check
+  if (!archetype || column >= archetype->systems->length || row >= archetype->length) { return NULL; }
+
+  // Index the chunk holding the row
+  uint8_t* base = *(uint8_t**)vector_at(archetype->chunks, row / archetype->chunk_capacity);
+  size_t size = (vector_get(archetype->systems, column, System*))->component_size;
+  return base + vector_get(archetype->offsets, column, size_t) + ((row % archetype->chunk_capacity) * size);
+}
+
+size_t archetype_column(Archetype* archetype, size_t bit) {
+  // Error check
+  if (!archetype || bit >= MARS_MAX_COMPONENTS) { return SIZE_MAX; }
+
+  // Columns are in bit order, so the column is the number of lower bits set
+  signature_t mask = (signature_t)1 << bit;
+  if (!(archetype->signature & mask)) { return SIZE_MAX; }
+  return archetype_popcount(archetype->signature & (mask - 1));
+}
+
+void archetype_destroy(Archetype* archetype) {
+  if (archetype) {
+    // Free chunks
+    if (archetype->chunks) {
+      vector_foreach(archetype->chunks, void*, chunk) {
+        allocator_free(archetype->chunk_allocator, *chunk, archetype->chunk_size);
+      }
+    }
+    vector_destroy(archetype->systems);
+    vector_destroy(archetype->offsets);
+    vector_destroy(archetype->chunks);
+    allocator_free(archetype->allocator, archetype, sizeof(*archetype));
+  }
+}
+
+
+/*=======================================================*/
+/* Iteration                                             */
+/*=======================================================*/
+
+void archetype_iter_next(ArchetypeIter* it) {
+  // Error check
+  if (!it) { return; }
+  it->length = 0;
+  it->entities = NULL;
+
+  // Walk the query's cached matches
+  if (it->__query) {
+    vector* matches = it->__query->matches;
+    while (it->__archetype < matches->length) {
+      QueryMatch* match = vector_at(matches, it->__archetype);
+      size_t chunk = it->__chunk++;
+      size_t first = chunk * match->archetype->chunk_capacity;
+      if (first < match->archetype->length) {
+        uint8_t* base = *(uint8_t**)vector_at(match->archetype->chunks, chunk);
+        size_t rows = match->archetype->length - first;
+        it->length = (rows < match->archetype->chunk_capacity) ? rows : match->archetype->chunk_capacity;
+        it->entities = (mars_id_t*)base;
+        for (size_t i = 0; i < it->__count; ++i) {
+          it->columns[i] = base + match->offsets[i];
+        }
+        return;
+      }
+      it->__archetype++;
+      it->__chunk = 0;
+    }
+    return;
+  }
+  if (!it->__archetypes) { return; }
+
+  // Find the next filled chunk of a matching archetype
+  while (it->__archetype < it->__archetypes->length) {
+    Archetype* archetype = vector_get(it->__archetypes, it->__archetype, Archetype*);
+    size_t chunk = it->__chunk++;
+    size_t first = chunk * archetype->chunk_capacity;
+    if ((archetype->signature & it->__signature) == it->__signature && first < archetype->length) {
+      uint8_t* base = *(uint8_t**)vector_at(archetype->chunks, chunk);
+      size_t* offsets = vector_data(archetype->offsets);
+      size_t rows = archetype->length - first;
+      it->length = (rows < archetype->chunk_capacity) ? rows : archetype->chunk_capacity;
+      it->entities = (mars_id_t*)base;
+      for (size_t i = 0; i < it->__count; ++i) {
+        it->columns[i] = base + offsets[archetype_column(archetype, it->__bits[i])];
+      }
+      return;
+    }
+    it->__archetype++;
+    it->__chunk = 0;
+  }
+}
+
+/*=======================================================*/
+/* Query                                                 */
+/*=======================================================*/
+
+void query_iter(Query* query, ArchetypeIter* it) {
+  // Error check
+  if (!it) { return; }
+  it->length = 0;
+  it->entities = NULL;
+  it->__archetypes = NULL;
+  it->__query = query;
+  it->__archetype = 0;
+  it->__chunk = 0;
+  it->__count = (query) ? query->count : 0;
+  it->__signature = 0;
+  if (query) { archetype_iter_next(it); }
+}
+
+size_t query_length(Query* query) {
+  // Error check
+  if (!query) { return 0; }
+
+  // Sum the rows of every match
+  size_t length = 0;
+  vector_foreach(query->matches, QueryMatch, match) {
+    length += match->archetype->length;
+  }
+  return length;
+}
\ No newline at end of file
@@ -0,0 +1,217 @@
+#ifndef MARS_EXPORTS
+  #define MARS_EXPORTS
+#endif
+#include "mars/mars_core.h"
+#include "mars/mars_trace.h"
+
+/*=======================================================*/
+/* Definitions                                           */
+/*=======================================================*/
+#define command_index_mask (((mars_id_t)1 << MARS_COMMAND_INDEX_BITS) - 1)
+#define command_buffer_max ((size_t)(ID_PENDING >> MARS_COMMAND_INDEX_BITS))
+#define command_pending(b, i) (ID_PENDING | ((mars_id_t)(b) << MARS_COMMAND_INDEX_BITS) | (mars_id_t)(i))
+
+// Command buffer of the calling thread
+static CommandBuffer* command_buffer(Engine* engine, const char* caller) {
+  size_t index = mars_thread_index();
+  if (!engine || index >= engine->command_count) {
+    mars_dlog(MARS_VERB_ERROR, "[%s] No command buffer for this thread!\n", caller);
+    return NULL;
+  }
+  return &engine->commands[index];
+}
+
+// Append a command to a buffer, copying the component data if given
+static uint8_t command_push(CommandBuffer* buffer, uint8_t type, mars_id_t system_id, mars_id_t entity_id, void* data, size_t size) {
+  Command command = { type, entity_id, system_id, SIZE_MAX, 0, buffer->commands->length };
+  if (data) {
+    // Grow the data block, keeping earlier copies in place
+    command.data = buffer->data->length;
+    if (command.data + size > buffer->data->__capacity) {
+      size_t capacity = buffer->data->__capacity;
+      while (capacity < command.data + size) { capacity *= 2; }
+      vector* temp = __vec_resize(buffer->data, capacity);
+      if (!temp) { return 1; }
+      buffer->data = temp;
+    }
+    memcpy(vector_at(buffer->data, command.data), data, size);
+    buffer->data->length += size;
+  }
+  if (vector_push_back(buffer->commands, &command) > 0) {
+    buffer->data->length = (data) ? command.data : buffer->data->length;
+    return 1;
+  }
+  return 0;
+}
+
+// Map a pending handle to the entity created for it (real handles pass through)
+static mars_id_t command_resolve(Engine* engine, mars_id_t entity_id) {
+  if (entity_id == ID_NULL || !(entity_id & ID_PENDING)) { return entity_id; }
+  size_t buffer = (size_t)((entity_id & ~ID_PENDING) >> MARS_COMMAND_INDEX_BITS);
+  size_t index = (size_t)(entity_id & command_index_mask);
+  if (buffer >= engine->command_count || index >= engine->commands[buffer].created->length) { return ID_NULL; }
+  return vector_get(engine->commands[buffer].created, index, mars_id_t);
+}
+
+// Order commands by system & entity slot so each storage is walked forwards, destructions
+// last. Adds & removes on the same component keep their recording order within a buffer.
+static int command_compare(const void* a, const void* b) {
+  const Command* x = a;
+  const Command* y = b;
+  bool xd = (x->type == MARS_COMMAND_DESTROY_ENTITY), yd = (y->type == MARS_COMMAND_DESTROY_ENTITY);
+  if (xd != yd) { return (xd) ? 1 : -1; }
+  if (x->system != y->system) { return (x->system < y->system) ? -1 : 1; }
+  size_t xi = entity_index(x->entity), yi = entity_index(y->entity);
+  if (xi != yi) { return (xi < yi) ? -1 : 1; }
+  if (x->buffer != y->buffer) { return (x->buffer < y->buffer) ? -1 : 1; }
+  if (x->seq != y->seq) { return (x->seq < y->seq) ? -1 : 1; }
+  return 0;
+}
+
+
+/*=======================================================*/
+/* Recording                                             */
+/*=======================================================*/
+
+mars_id_t engine_defer_new_entity(Engine* engine) {
+  // Error check
+  CommandBuffer* buffer = command_buffer(engine, "engine_defer_new_entity");
+  if (!buffer) { return ID_NULL; }
+  size_t index = (size_t)(buffer - engine->commands);
+  if (index >= command_buffer_max || buffer->creates > command_index_mask) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_defer_new_entity] Too many pending entities!\n");
+    return ID_NULL;
+  }
+
+  // The entity is created at the start of the next flush
+  return command_pending(index, buffer->creates++);
+}
+
+uint8_t engine_defer_new_entity_component(Engine* engine, mars_id_t system_id, mars_id_t entity_id) {
+  // Error check
+  CommandBuffer* buffer = command_buffer(engine, "engine_defer_new_entity_component");
+  if (!buffer || entity_id == ID_NULL) { return 1; }
+
+  // Record
+  return command_push(buffer, MARS_COMMAND_ADD_COMPONENT, system_id, entity_id, NULL, 0);
+}
+
+uint8_t engine_defer_add_entity_component(Engine* engine, mars_id_t system_id, mars_id_t entity_id, void* component) {
+  // Error check
+  CommandBuffer* buffer = command_buffer(engine, "engine_defer_add_entity_component");
+  if (!buffer || entity_id == ID_NULL || !component) { return 1; }
+  System* system = engine_get_system(engine, system_id);
+  if (!system) { return 1; }
+
+  // Record with a copy of the component
+  return command_push(buffer, MARS_COMMAND_ADD_COMPONENT, system_id, entity_id, component, system->component_size);
+}
+
+uint8_t engine_defer_remove_entity_component(Engine* engine, mars_id_t system_id, mars_id_t entity_id) {
+  // Error check
+  CommandBuffer* buffer = command_buffer(engine, "engine_defer_remove_entity_component");
+  if (!buffer || entity_id == ID_NULL) { return 1; }
+
+  // Record
+  return command_push(buffer, MARS_COMMAND_REMOVE_COMPONENT, system_id, entity_id, NULL, 0);
+}
+
+uint8_t engine_defer_destroy_entity(Engine* engine, mars_id_t entity_id) {
+  // Error check
+  CommandBuffer* buffer = command_buffer(engine, "engine_defer_destroy_entity");
+  if (!buffer || entity_id == ID_NULL) { return 1; }
+
+  // Record
+  return command_push(buffer, MARS_COMMAND_DESTROY_ENTITY, ID_NULL, entity_id, NULL, 0);
+}
+
+
+/*=======================================================*/
+/* Flush                                                 */
+/*=======================================================*/
+
+void engine_flush(Engine* engine) {
+  // Error check
+  if (!engine || !engine->commands) { return; }
+  MARS_TRACE_BEGIN("engine_flush", 0);
+
+  // Create pending entities in recording order
+  for (size_t b = 0; b < engine->command_count; ++b) {
+    CommandBuffer* buffer = &engine->commands[b];
+    buffer->created->length = 0;
+    for (size_t i = 0; i < buffer->creates; ++i) {
+      mars_id_t entity_id = engine_new_entity(engine);
+      if (entity_id == ID_NULL) {
+        mars_dlog(MARS_VERB_ERROR, "[engine_flush] Failed to create entity!\n");
+      }
+      vector_push_back(buffer->created, &entity_id);
+    }
+    buffer->creates = 0;
+  }
+
+  // Gather the rest with their handles resolved
+  engine->command_sort->length = 0;
+  for (size_t b = 0; b < engine->command_count; ++b) {
+    CommandBuffer* buffer = &engine->commands[b];
+    buffer->__flushed = buffer->commands->length;
+    buffer->__flushed_data = buffer->data->length;
+    vector_foreach(buffer->commands, Command, command) {
+      command->entity = command_resolve(engine, command->entity);
+      command->buffer = b;
+      if (command->entity != ID_NULL && vector_push_back(engine->command_sort, command) > 0) {
+        mars_dlog(MARS_VERB_ERROR, "[engine_flush] Failed to queue command!\n");
+      }
+    }
+  }
+  qsort(vector_data(engine->command_sort), engine->command_sort->length, sizeof(Command), command_compare);
+
+  // Apply, commands on entities or components that are already gone do nothing
+  Command* commands = vector_data(engine->command_sort);
+  size_t count = engine->command_sort->length;
+  size_t destroys = count;
+  vector_foreach(engine->command_sort, Command, command) {
+    if (command->type == MARS_COMMAND_DESTROY_ENTITY) {
+      destroys = (size_t)(command - commands);
+      break;
+    }
+    switch (command->type) {
+      case MARS_COMMAND_ADD_COMPONENT:
+        if (command->data == SIZE_MAX) {
+          engine_new_entity_component(engine, command->system, command->entity);
+        }
+        else {
+          engine_add_entity_component(engine, command->system, command->entity, vector_at(engine->commands[command->buffer].data, command->data));
+        }
+      break;
+      case MARS_COMMAND_REMOVE_COMPONENT:
+        engine_remove_entity_component(engine, command->system, command->entity);
+      break;
+    }
+  }
+
+  // Destructions sort last, pack their handles over the front of the run & destroy them together
+  mars_id_t* doomed = (mars_id_t*)(commands + destroys);
+  for (size_t i = destroys; i < count; ++i) {
+    doomed[i - destroys] = commands[i].entity;
+  }
+  engine_destroy_entities(engine, doomed, count - destroys);
+  engine->command_sort->length = 0;
+
+  // Drop the applied commands, keeping any recorded by callbacks during the flush
+  for (size_t b = 0; b < engine->command_count; ++b) {
+    CommandBuffer* buffer = &engine->commands[b];
+    size_t left = buffer->commands->length - buffer->__flushed;
+    size_t left_data = buffer->data->length - buffer->__flushed_data;
+    memmove(vector_data(buffer->commands), vector_at(buffer->commands, buffer->__flushed), sizeof(Command) * left);
+    memmove(vector_data(buffer->data), vector_at(buffer->data, buffer->__flushed_data), left_data);
+    buffer->commands->length = left;
+    buffer->data->length = left_data;
+    vector_foreach(buffer->commands, Command, command) {
+      command->seq -= buffer->__flushed;
+      command->data = (command->data != SIZE_MAX) ? command->data - buffer->__flushed_data : SIZE_MAX;
+    }
+    buffer->__flushed = 0;
+    buffer->__flushed_data = 0;
+  }
+  MARS_TRACE_END("engine_flush", 0);
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
   #define MARS_EXPORTS
 #endif
 #include "mars/mars_core.h"
+#include "mars/mars_trace.h"
 
 /*=======================================================*/
 /* Definitions                                           */
@@ -18,6 +19,10 @@
 /*=======================================================*/
 /* Environment-specific code                             */
 /*=======================================================*/
+#if defined(MARS_X86) && defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
 #if defined(_WIN32)
   int gettimeofday(struct timeval* tp, struct timezone* tzp) {
     static const uint64_t EPOCH = ((uint64_t)116444736000000000ULL);
@@ -35,14 +40,21 @@
     tp->tv_usec = (long)(system_time.wMilliseconds * 1000);
     return 0;
   }
+#else
+  #include <time.h>
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
 #endif
 
 
 /*=======================================================*/
 /* Global functions                                      */
 /*=======================================================*/
-id_t uuid_generate() {
-  return (id_t)(RAND & (ID_NULL - 1));
+mars_id_t uuid_generate() {
+  return (mars_id_t)(RAND & (ID_NULL - 1));
 }
 
 void mars_dlog(uint8_t level, const char* format, ...) {
@@ -55,72 +67,443 @@ void mars_dlog(uint8_t level, const char* format, ...) {
   #endif
 }
 
+uint64_t mars_time_ns() {
+  #if defined(_WIN32)
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) { QueryPerformanceFrequency(&frequency); }
+    QueryPerformanceCounter(&counter);
+    uint64_t seconds = (uint64_t)(counter.QuadPart / frequency.QuadPart);
+    uint64_t rest = (uint64_t)(counter.QuadPart % frequency.QuadPart);
+    return (seconds * 1000000000ULL) + ((rest * 1000000000ULL) / (uint64_t)frequency.QuadPart);
+  #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+  #endif
+}
+
+void mars_sleep_until(uint64_t deadline) {
+  #if defined(_WIN32)
+    // Sleep only wakes on scheduler ticks, so stop early & yield through the rest
+    uint64_t now = mars_time_ns();
+    if (deadline > now + 2000000) {
+      Sleep((DWORD)((deadline - now) / 1000000) - 1);
+    }
+    while (mars_time_ns() < deadline) { SwitchToThread(); }
+  #else
+    struct timespec ts = { (time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+  #endif
+}
+
+void* mars_map_file(const char* path, size_t* size) {
+  // Error check
+  if (!path || !size) { return NULL; }
+  void* data = NULL;
+  #if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return NULL; }
+    LARGE_INTEGER length;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+      // The view keeps the mapping alive once both handles are closed
+      HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+      if (mapping) {
+        data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+      }
+      *size = (size_t)length.QuadPart;
+    }
+    CloseHandle(file);
+  #else
+    int file = open(path, O_RDONLY);
+    if (file < 0) { return NULL; }
+    struct stat info;
+    if (fstat(file, &info) == 0 && info.st_size > 0) {
+      data = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+      data = (data == MAP_FAILED) ? NULL : data;
+      *size = (size_t)info.st_size;
+    }
+    close(file);
+  #endif
+  return data;
+}
+
+void mars_unmap_file(void* data, size_t size) {
+  if (!data) { return; }
+  #if defined(_WIN32)
+    UnmapViewOfFile(data);
+  #else
+    munmap(data, size);
+  #endif
+}
+
+uint8_t mars_simd_support() {
+  uint8_t flags = MARS_SIMD_NONE;
+  #if defined(MARS_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) { flags |= MARS_SIMD_SSE2; }
+    // AVX state must be enabled by the OS (OSXSAVE + XCR0 bits 1 & 2)
+    if ((info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6) {
+      if (info[2] & (1 << 12)) { flags |= MARS_SIMD_FMA; }
+      __cpuidex(info, 7, 0);
+      if (info[1] & (1 << 5)) { flags |= MARS_SIMD_AVX2; }
+    }
+  #elif defined(MARS_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) { flags |= MARS_SIMD_SSE2; }
+    if (__builtin_cpu_supports("avx2")) { flags |= MARS_SIMD_AVX2; }
+    if (__builtin_cpu_supports("fma")) { flags |= MARS_SIMD_FMA; }
+  #endif
+  return flags;
+}
+
 
 /*=======================================================*/
 /* System                                                */
 /*=======================================================*/
 
 System* system_create(size_t component_size, fptr_t init, fptr_t update, fptr_t destroy) {
+  return system_create_alloc(component_size, init, update, destroy, NULL);
+}
+
+System* system_create_alloc(size_t component_size, fptr_t init, fptr_t update, fptr_t destroy, allocator* alloc) {
   // Assign default values
-  System* system = malloc(sizeof(*system));
+  System* system = allocator_alloc(alloc, sizeof(*system));
   if (!system) { 
-    mars_dlog(MARS_VERB_ERROR, "[system_create] malloc failed!\n");
+    mars_dlog(MARS_VERB_ERROR, "[system_create_alloc] Allocation failed!\n");
     return NULL; 
   }
-  system->components = unordered_map_create(void*);
-  if (!system->components) {
-    mars_dlog(MARS_VERB_ERROR, "[system_create] Failed to create component map!\n");
-    free(system);
+  system->allocator = alloc;
+  system->profile = NULL;
+  system->sparse = vector_create_alloc(size_t, alloc);
+  system->components = vector_create_size_alloc(component_size, alloc);
+  system->entities = vector_create_alloc(mars_id_t, alloc);
+  system->reads = vector_create_alloc(mars_id_t, alloc);
+  system->writes = vector_create_alloc(mars_id_t, alloc);
+  system->columns = vector_create_alloc(ArchetypeColumn, alloc);
+  if (!system->sparse || !system->components || !system->entities || !system->reads || !system->writes || !system->columns) {
+    mars_dlog(MARS_VERB_ERROR, "[system_create_alloc] Failed to create component storage!\n");
+    vector_destroy(system->sparse);
+    vector_destroy(system->components);
+    vector_destroy(system->entities);
+    vector_destroy(system->reads);
+    vector_destroy(system->writes);
+    vector_destroy(system->columns);
+    allocator_free(alloc, system, sizeof(*system));
     return NULL;
   }
   system->init = init;
   system->update = update;
+  system->init_batch = NULL;
+  system->update_batch = NULL;
   system->destroy = destroy;
+  system->destroy_batch = NULL;
+  system->grain = 0;
+  system->scratch_size = 0;
+  system->scratch_count = 0;
+  system->scratch = NULL;
   system->uuid = uuid_generate();
   system->component_size = component_size;
+  system->storage = MARS_STORAGE_SPARSE;
+  system->bit = SIZE_MAX;
 
   return system;
 }
 
-uint8_t system_new_component(System* system, id_t entity_id) {
+// Packed index of the entity's component (SIZE_MAX if it has none)
+static size_t system_find(System* system, mars_id_t entity_id) {
+  return entity_sparse_find(system->sparse, vector_data(system->entities), system->entities->length, entity_id);
+}
+
+// Reserve a packed slot for the entity and return a reference to it
+static void* system_emplace(System* system, mars_id_t entity_id) {
+  // Archetype-stored components go through the engine
+  if (system->storage != MARS_STORAGE_SPARSE) {
+    mars_dlog(MARS_VERB_ERROR, "[system_emplace] System uses archetype storage, add components through the engine!\n");
+    return NULL;
+  }
+
+  // Entities can only hold one component per system
+  if (system_find(system, entity_id) != SIZE_MAX) { return NULL; }
+
+  // Append to the packed arrays
+  size_t index = system->components->length;
+  void* component = vector_emplace_back(system->components);
+  if (!component) { return NULL; }
+  if (vector_push_back(system->entities, &entity_id) > 0) {
+    system->components->length--;
+    return NULL;
+  }
+
+  // Map the entity to its packed index
+  if (entity_sparse_set(&system->sparse, entity_id, index) > 0) {
+    system->components->length--;
+    system->entities->length--;
+    return NULL;
+  }
+  return component;
+}
+
+// Fill a contiguous range of new components with copies of a prototype (zeroed if NULL) & initialize it
+static void system_fill(System* system, uint8_t* data, size_t count, void* prototype, mars_id_t* entities) {
+  size_t stride = system->component_size;
+  if (prototype) {
+    // Copy the first component, then double the copied range each step
+    memcpy(data, prototype, stride);
+    for (size_t done = 1; done < count;) {
+      size_t n = (done < count - done) ? done : count - done;
+      memcpy(data + (done * stride), data, n * stride);
+      done += n;
+    }
+  }
+  else {
+    memset(data, 0, count * stride);
+  }
+
+  // Run init function
+  if (system->init_batch) {
+    void* args[] = {data, &count, &stride, entities};
+    system->init_batch(4, args);
+  }
+  else if (system->init) {
+    for (size_t i = 0; i < count; ++i) {
+      void* args[] = {data + (i * stride), &entities[i]};
+      system->init(2, args);
+    }
+  }
+}
+
+uint8_t system_new_component(System* system, mars_id_t entity_id) {
   // Error check
   if (!system) { return 1; }
   
-  // Allocate space for component
-  void* component = malloc(system->component_size);
+  // Reserve space for component
+  void* component = system_emplace(system, entity_id);
   if (!component) { return 1; }
+  memset(component, 0, system->component_size);
 
   // Run init function
   if (system->init) {
     void* args[] = {component, &entity_id};
     system->init(2, args);
   }
-
-  // Attempt to insert
-  return unordered_map_insert(system->components, entity_id, &component);
+  return 0;
 }
 
-uint8_t system_add_component(System* system, id_t entity_id, void* component) {
+uint8_t system_add_component(System* system, mars_id_t entity_id, void* component) {
   // Error check
-  if (!system) { return 1; }
+  if (!system || !component) { return 1; }
+
+  // Reserve space & copy component
+  void* dest = system_emplace(system, entity_id);
+  if (!dest) { return 1; }
+  memcpy(dest, component, system->component_size);
 
   // Run function
   if (system->init) {
-    void* args[] = {component, &entity_id};
+    void* args[] = {dest, &entity_id};
     system->init(2, args);
   }
+  return 0;
+}
+
+// Drop the packed component at the given index without running its destroy function.
+// The last component moves into the hole, so freed slots are reused by the next insert.
+static void system_erase(System* system, size_t index) {
+  void* component = vector_at(system->components, index);
+  mars_id_t entity_id = vector_get(system->entities, index, mars_id_t);
+  size_t last = system->components->length - 1;
+  if (index != last) {
+    mars_id_t moved_id = vector_get(system->entities, last, mars_id_t);
+    memcpy(component, vector_at(system->components, last), system->component_size);
+    memcpy(vector_at(system->entities, index), &moved_id, sizeof(mars_id_t));
+    entity_sparse_set(&system->sparse, moved_id, index);
+  }
+  entity_sparse_set(&system->sparse, entity_id, SIZE_MAX);
+  vector_pop_back(system->components);
+  vector_pop_back(system->entities);
+}
+
+// Run the destroy function over a list of components, once if the system has destroy_batch
+static void system_run_destroy(System* system, void** components, size_t count) {
+  if (count == 0) { return; }
+  if (system->destroy_batch) {
+    void* args[] = {components, &count};
+    system->destroy_batch(2, args);
+  }
+  else if (system->destroy) {
+    for (size_t i = 0; i < count; ++i) {
+      void* args[] = {components[i]};
+      system->destroy(1, args);
+    }
+  }
+}
+
+uint8_t system_remove_component(System* system, mars_id_t entity_id) {
+  // Error check
+  if (!system) { return 1; }
+
+  // Find packed index
+  size_t index = system_find(system, entity_id);
+  if (index == SIZE_MAX) { return 1; }
 
-  // Attemp to insert
-  return unordered_map_insert(system->components, entity_id, &component);
+  // Run destroy function
+  void* component = vector_at(system->components, index);
+  system_run_destroy(system, &component, 1);
+
+  // Keep the array packed
+  system_erase(system, index);
+  return 0;
 }
 
-void* system_get_component(System* system, id_t entity_id) {
+void* system_get_component(System* system, mars_id_t entity_id) {
   // Error check
   if (!system) { return NULL; }
 
   // Attempt to find
-  void** data = unordered_map_find(system->components, entity_id);
-  return (data) ? (*data) : NULL;
+  size_t index = system_find(system, entity_id);
+  return (index != SIZE_MAX) ? vector_at(system->components, index) : NULL;
+}
+
+uint8_t system_reserve(System* system, size_t count) {
+  // Error check
+  if (!system) { return 1; }
+
+  // Packed arrays, plus sparse entries for that many densely numbered entities
+  if (vector_reserve(system->components, count) > 0 || vector_reserve(system->entities, count) > 0) { return 1; }
+  return vector_reserve(system->sparse, count);
+}
+
+uint8_t system_shrink_to_fit(System* system) {
+  // Error check
+  if (!system) { return 1; }
+
+  // Sparse entries past the last entity with a component are unused
+  while (system->sparse->length > 0 && *(size_t*)vector_at(system->sparse, system->sparse->length - 1) == SIZE_MAX) {
+    system->sparse->length--;
+  }
+  uint8_t result = vector_shrink_to_fit(system->sparse);
+  result |= vector_shrink_to_fit(system->components);
+  result |= vector_shrink_to_fit(system->entities);
+  result |= vector_shrink_to_fit(system->columns);
+  return result;
+}
+
+uint8_t system_add_read(System* system, mars_id_t system_id) {
+  // Error check
+  if (!system) { return 1; }
+  return vector_push_back(system->reads, &system_id);
+}
+
+uint8_t system_add_write(System* system, mars_id_t system_id) {
+  // Error check
+  if (!system) { return 1; }
+  return vector_push_back(system->writes, &system_id);
+}
+
+// Check if a system's declared access touches the components of the given system
+static bool system_accesses(System* system, mars_id_t system_id, bool include_reads) {
+  if (system->uuid == system_id) { return true; }
+  mars_id_t* writes = vector_data(system->writes);
+  for (size_t i = 0; i < system->writes->length; ++i) {
+    if (writes[i] == system_id) { return true; }
+  }
+  if (include_reads) {
+    mars_id_t* reads = vector_data(system->reads);
+    for (size_t i = 0; i < system->reads->length; ++i) {
+      if (reads[i] == system_id) { return true; }
+    }
+  }
+  return false;
+}
+
+// Check if two systems must not run at the same time (either writes what the other touches)
+static bool system_conflicts(System* a, System* b) {
+  mars_id_t* writes = vector_data(a->writes);
+  if (system_accesses(b, a->uuid, true)) { return true; }
+  for (size_t i = 0; i < a->writes->length; ++i) {
+    if (system_accesses(b, writes[i], true)) { return true; }
+  }
+  writes = vector_data(b->writes);
+  if (system_accesses(a, b->uuid, true)) { return true; }
+  for (size_t i = 0; i < b->writes->length; ++i) {
+    if (system_accesses(a, writes[i], true)) { return true; }
+  }
+  return false;
+}
+
+// Update a contiguous block of components
+static void system_update_block(System* system, uint8_t* data, size_t count, float* dt) {
+  size_t stride = system->component_size;
+  void* scratch = NULL;
+  if (system->scratch_size > 0) {
+    size_t index = mars_thread_index();
+    scratch = (uint8_t*)system->scratch + ((index < system->scratch_count ? index : 0) * system->scratch_size);
+  }
+
+  // Hand the whole range over in one call
+  if (system->update_batch) {
+    if (count > 0) {
+      void* args[] = {data, &count, &stride, dt, scratch};
+      system->update_batch(scratch ? 5 : 4, args);
+    }
+  }
+  // Walk the packed components
+  else if (system->update) {
+    for (size_t i = 0; i < count; ++i) {
+      void* args[] = {data + (i * stride), dt, scratch};
+      system->update(scratch ? 3 : 2, args);
+    }
+  }
+}
+
+// Update the packed components in [begin, end)
+static void system_update_range(System* system, size_t begin, size_t end, float* dt) {
+  system_update_block(system, (uint8_t*)vector_data(system->components) + (begin * system->component_size), end - begin, dt);
+}
+
+// Update the archetype chunks in [begin, end), numbered across every column of the system
+static void system_update_chunks(System* system, size_t begin, size_t end, float* dt) {
+  size_t first = 0;
+  vector_foreach(system->columns, ArchetypeColumn, column) {
+    if (first >= end) { break; }
+    Archetype* archetype = column->archetype;
+    size_t chunks = (archetype->length + (archetype->chunk_capacity - 1)) / archetype->chunk_capacity;
+    for (size_t c = (begin > first) ? begin - first : 0; c < chunks && first + c < end; ++c) {
+      uint8_t* base = *(uint8_t**)vector_at(archetype->chunks, c);
+      size_t rows = archetype->length - (c * archetype->chunk_capacity);
+      system_update_block(system, base + column->offset, (rows < archetype->chunk_capacity) ? rows : archetype->chunk_capacity, dt);
+    }
+    first += chunks;
+  }
+}
+
+// Count the components & archetype chunks of a system
+static size_t system_length(System* system, size_t* chunks) {
+  if (system->storage == MARS_STORAGE_SPARSE) {
+    *chunks = 0;
+    return system->components->length;
+  }
+  size_t length = 0;
+  *chunks = 0;
+  vector_foreach(system->columns, ArchetypeColumn, column) {
+    length += column->archetype->length;
+    *chunks += (column->archetype->length + (column->archetype->chunk_capacity - 1)) / column->archetype->chunk_capacity;
+  }
+  return length;
+}
+
+// Make sure there is a scratch buffer for every thread that may update the system
+static uint8_t system_reserve_scratch(System* system, size_t thread_count) {
+  if (system->scratch_size == 0 || system->scratch_count >= thread_count) { return 0; }
+  void* scratch = allocator_realloc(system->allocator, system->scratch, system->scratch_size * system->scratch_count, system->scratch_size * thread_count);
+  if (!scratch) { return 1; }
+  memset((uint8_t*)scratch + (system->scratch_size * system->scratch_count), 0, system->scratch_size * (thread_count - system->scratch_count));
+  system->scratch = scratch;
+  system->scratch_count = thread_count;
+  return 0;
 }
 
 void system_update(System* system, float* dt) {
@@ -129,39 +512,102 @@ void system_update(System* system, float* dt) {
     mars_dlog(MARS_VERB_ERROR, "[system_update] System reference NULL!\n");
     return; 
   }
+  if (system_reserve_scratch(system, 1) > 0) { return; }
+  if (system->storage == MARS_STORAGE_ARCHETYPE) {
+    system_update_chunks(system, 0, SIZE_MAX, dt);
+  }
+  else {
+    system_update_range(system, 0, system->components->length, dt);
+  }
+}
 
-  // Iterate through components
-  if (system->update) {
-    for(umap_it_t* it = unordered_map_it(system->components); it; unordered_map_it_next(it)) {
-      void* args[] = {*(void**)(it->data), dt};
-      system->update(2, args);
-    }
+uint8_t system_set_parallel(System* system, size_t grain, size_t scratch_size) {
+  // Error check
+  if (!system) { return 1; }
+
+  // Drop scratch buffers of the old size
+  if (scratch_size != system->scratch_size) {
+    allocator_free(system->allocator, system->scratch, system->scratch_size * system->scratch_count);
+    system->scratch = NULL;
+    system->scratch_count = 0;
+  }
+  system->grain = grain;
+  system->scratch_size = scratch_size;
+  return 0;
+}
+
+// Parallel-for wrapper around system_update_range
+static uint8_t system_update_chunk(size_t num, void** args) {
+  system_update_range((System*)args[2], *(size_t*)args[0], *(size_t*)args[1], (float*)args[3]);
+  return 0;
+}
+
+// Parallel-for wrapper around system_update_chunks
+static uint8_t system_update_archetype_chunk(size_t num, void** args) {
+  system_update_chunks((System*)args[2], *(size_t*)args[0], *(size_t*)args[1], (float*)args[3]);
+  return 0;
+}
+
+void system_update_parallel(System* system, float* dt, ThreadPool* pool) {
+  // Error check
+  if (!system) { 
+    mars_dlog(MARS_VERB_ERROR, "[system_update_parallel] System reference NULL!\n");
+    return; 
+  }
+
+  // Fall back to one thread
+  size_t chunks;
+  size_t length = system_length(system, &chunks);
+  if (!pool || system->grain == 0 || length <= system->grain || (system->storage == MARS_STORAGE_ARCHETYPE && chunks <= 1)) {
+    system_update(system, dt);
+    return;
+  }
+
+  // Split the packed components across the pool, archetype storage is split a chunk at a time
+  if (system_reserve_scratch(system, pool->thread_count + 1) > 0) { return; }
+  void* args[] = {system, dt};
+  if (system->storage == MARS_STORAGE_ARCHETYPE) {
+    thread_pool_parallel_for(pool, chunks, 1, system_update_archetype_chunk, 2, args);
+  }
+  else {
+    thread_pool_parallel_for(pool, system->components->length, system->grain, system_update_chunk, 2, args);
   }
 }
 
 void system_destroy(System* system) {
   if (system) {
-    // Iterate through components
-    if (system->destroy) {
-      for(umap_it_t* it = unordered_map_it(system->components); it; unordered_map_it_next(it)) {
-        // Get double reference
-        void** data = it->data;
-        
-        // Run destroy function
-        void* args[] = {*data};
-        system->destroy(1, args);
-
-        // Destroy base object
-        free(*data);
+    // Run destroy function on every component, a batch of pointers at a time
+    if (system->destroy || system->destroy_batch) {
+      void* batch[64];
+      size_t count = 0;
+      uint8_t* data = vector_data(system->components);
+      for (size_t i = 0; i < system->components->length; ++i) {
+        batch[count++] = data + (i * system->component_size);
+        if (count == 64) { system_run_destroy(system, batch, count); count = 0; }
+      }
+      vector_foreach(system->columns, ArchetypeColumn, column) {
+        for (size_t row = 0; row < column->archetype->length; ++row) {
+          uint8_t* base = *(uint8_t**)vector_at(column->archetype->chunks, row / column->archetype->chunk_capacity);
+          batch[count++] = base + column->offset + ((row % column->archetype->chunk_capacity) * system->component_size);
+          if (count == 64) { system_run_destroy(system, batch, count); count = 0; }
+        }
       }
+      system_run_destroy(system, batch, count);
     }
 
-    // Destroy component map
-    unordered_map_destroy(system->components);
+    // Destroy component storage
+    vector_destroy(system->sparse);
+    vector_destroy(system->components);
+    vector_destroy(system->entities);
+    vector_destroy(system->reads);
+    vector_destroy(system->writes);
+    vector_destroy(system->columns);
+    allocator_free(system->allocator, system->scratch, system->scratch_size * system->scratch_count);
+    system_set_profiling(system, false);
+
+    // Destroy struct
+    allocator_free(system->allocator, system, sizeof(*system));
   }
-
-  // Destroy struct
-  free(system);
 }
 
 
@@ -169,29 +615,158 @@ void system_destroy(System* system) {
 /* Engine                                                */
 /*=======================================================*/
 
+// Replace the command buffers with the given number of empty ones, pending commands are dropped
+static uint8_t engine_command_buffers(Engine* engine, size_t count) {
+  // Free existing buffers
+  for (size_t i = 0; i < engine->command_count; ++i) {
+    vector_destroy(engine->commands[i].commands);
+    vector_destroy(engine->commands[i].data);
+    vector_destroy(engine->commands[i].created);
+  }
+  allocator_free(engine->allocator, engine->commands, sizeof(CommandBuffer) * engine->command_capacity);
+  engine->commands = NULL;
+  engine->command_count = 0;
+  engine->command_capacity = 0;
+  if (count == 0) { return 0; }
+
+  // One buffer per thread
+  engine->commands = allocator_alloc(engine->allocator, sizeof(CommandBuffer) * count);
+  if (!engine->commands) { return 1; }
+  engine->command_capacity = count;
+  for (size_t i = 0; i < count; ++i) {
+    CommandBuffer* buffer = &engine->commands[i];
+    buffer->commands = vector_create_alloc(Command, engine->allocator);
+    buffer->data = vector_create_size_alloc(1, engine->allocator);
+    buffer->created = vector_create_alloc(mars_id_t, engine->allocator);
+    buffer->creates = 0;
+    buffer->__flushed = 0;
+    buffer->__flushed_data = 0;
+    engine->command_count++;
+    if (!buffer->commands || !buffer->data || !buffer->created) {
+      engine_command_buffers(engine, 0);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Keep a pair of frame arenas for each of the given number of threads, existing ones keep their contents
+static uint8_t engine_frame_arenas(Engine* engine, size_t count) {
+  // Free arenas of threads that are gone
+  for (size_t i = count * 2; i < engine->frame_count * 2; ++i) {
+    frame_arena_destroy(engine->frames[i]);
+  }
+  if (count == 0) {
+    allocator_free(engine->allocator, engine->frames, sizeof(FrameArena*) * engine->frame_capacity * 2);
+    engine->frames = NULL;
+    engine->frame_count = 0;
+    engine->frame_capacity = 0;
+    return 0;
+  }
+  engine->frame_count = (count < engine->frame_count) ? count : engine->frame_count;
+
+  // Resize the list, creating arenas for new threads
+  FrameArena** frames = allocator_realloc(engine->allocator, engine->frames, sizeof(FrameArena*) * engine->frame_capacity * 2, sizeof(FrameArena*) * count * 2);
+  if (!frames) { return 1; }
+  engine->frames = frames;
+  engine->frame_capacity = count;
+  for (size_t i = engine->frame_count * 2; i < count * 2; ++i) {
+    frames[i] = frame_arena_create(engine->allocator, MARS_FRAME_ARENA_SIZE);
+    if (!frames[i]) {
+      for (size_t j = engine->frame_count * 2; j < i; ++j) { frame_arena_destroy(frames[j]); }
+      return 1;
+    }
+  }
+  engine->frame_count = count;
+  return 0;
+}
+
+// Start the next frame: the arenas filled two ticks ago are emptied and take new allocations
+static void engine_next_frame(Engine* engine) {
+  engine->frame ^= 1;
+  for (size_t i = 0; i < engine->frame_count; ++i) {
+    frame_arena_reset(engine->frames[(i * 2) + engine->frame]);
+  }
+}
+
+// Free the engine struct through whatever it was allocated with
+static void engine_free(Engine* engine) {
+  if (engine->allocator == &engine->heap.base) { free(engine); }
+  else { allocator_free(engine->allocator, engine, sizeof(*engine)); }
+}
+
 Engine* engine_create(fptr_t init, fptr_t destroy, int argc, char** argv) {
+  return engine_create_alloc(init, destroy, argc, argv, NULL);
+}
+
+Engine* engine_create_alloc(fptr_t init, fptr_t destroy, int argc, char** argv, allocator* alloc) {
   // Assign default values
-  Engine* engine = malloc(sizeof(*engine));
+  Engine* engine = allocator_alloc(alloc, sizeof(*engine));
   if (!engine) { return NULL; }
+  heap_allocator_init(&engine->heap);
+  engine->allocator = (alloc) ? alloc : &engine->heap.base;
   engine->init = init;
   engine->destroy = destroy;
-  engine->old_time = (const struct timeval){0};
-  engine->new_time = (const struct timeval){0};
+  engine->old_time = 0;
+  engine->loop_mode = MARS_LOOP_SLEEP;
+  engine->max_steps = MARS_MAX_STEPS;
+  engine->max_accum = MARS_MAX_ACCUM;
+  engine->dilate = false;
+  engine->loop_stats = (const EngineLoopStats){0};
+  engine->step = 0;
+  engine->profiling = false;
+  engine->profile = NULL;
   engine->time_accum = 0.0f;
   engine->render_alpha = 0.0f;
   engine->dt = 0.01f;
   engine->run = true;
-  engine->systems = unordered_map_create(System*);
-  engine->entities = unordered_map_create(Entity*);
+  engine->systems = unordered_map_create_alloc(System*, engine->allocator);
+  engine->entities = lot_create_alloc(Entity, engine->allocator);
+  engine->system_order = vector_create_alloc(System*, engine->allocator);
+  engine->schedule = vector_create_alloc(System*, engine->allocator);
+  engine->schedule_phase = vector_create_alloc(size_t, engine->allocator);
+  engine->pool = NULL;
+  engine->archetypes = vector_create_alloc(Archetype*, engine->allocator);
+  engine->archetype_index = unordered_map_create_alloc(Archetype*, engine->allocator);
+  engine->queries = vector_create_alloc(Query*, engine->allocator);
+  engine->chunk_pool = pool_allocator_create(engine->allocator, MARS_ARCHETYPE_CHUNK, MARS_ARCHETYPE_SLAB);
+  engine->commands = NULL;
+  engine->command_count = 0;
+  engine->command_capacity = 0;
+  engine->command_sort = vector_create_alloc(Command, engine->allocator);
+  engine->destroy_list = vector_create_alloc(mars_id_t, engine->allocator);
+  engine->destroy_components = vector_create_alloc(void*, engine->allocator);
+  engine->frames = NULL;
+  engine->frame_count = 0;
+  engine->frame_capacity = 0;
+  engine->frame = 0;
+  engine->snapshot = NULL;
+  engine->snapshot_size = 0;
+  engine->snapshot_allocator = (const allocator){0};
 
   // Error check
-  if (!engine->systems || !engine->entities) {
-    free(engine);
+  if (!engine->systems || !engine->entities || !engine->system_order || !engine->schedule || !engine->schedule_phase || !engine->archetypes || !engine->archetype_index || !engine->queries ||
+      !engine->chunk_pool || !engine->command_sort || !engine->destroy_list || !engine->destroy_components || engine_command_buffers(engine, 1) > 0 || engine_frame_arenas(engine, 1) > 0) {
+    unordered_map_destroy(engine->systems);
+    lot_destroy(engine->entities);
+    vector_destroy(engine->system_order);
+    vector_destroy(engine->schedule);
+    vector_destroy(engine->schedule_phase);
+    vector_destroy(engine->archetypes);
+    unordered_map_destroy(engine->archetype_index);
+    vector_destroy(engine->queries);
+    vector_destroy(engine->command_sort);
+    vector_destroy(engine->destroy_list);
+    vector_destroy(engine->destroy_components);
+    pool_allocator_destroy(engine->chunk_pool);
+    engine_command_buffers(engine, 0);
+    engine_frame_arenas(engine, 0);
+    engine_free(engine);
     return NULL;
   }
 
   // Get current time
-	gettimeofday(&(engine->old_time), 0);
+  engine->old_time = mars_time_ns();
 
   // Process command line flags
   #ifndef NDEBUG
@@ -216,7 +791,7 @@ Engine* engine_create(fptr_t init, fptr_t destroy, int argc, char** argv) {
   return engine;
 }
 
-id_t engine_new_system(Engine* engine, size_t component_size, fptr_t init, fptr_t update, fptr_t destroy) {
+mars_id_t engine_new_system(Engine* engine, size_t component_size, fptr_t init, fptr_t update, fptr_t destroy) {
   // Error check
   if (!engine) { 
     mars_dlog(MARS_VERB_ERROR, "[engine_new_system] Engine reference NULL!\n");
@@ -224,16 +799,17 @@ id_t engine_new_system(Engine* engine, size_t component_size, fptr_t init, fptr_
   }
 
   // Allocate space for system
-  System* system = system_create(component_size, init, update, destroy);
+  System* system = system_create_alloc(component_size, init, update, destroy, engine->allocator);
   if (!system) { 
     mars_dlog(MARS_VERB_ERROR, "[engine_new_system] Failed to create system!\n");
     return ID_NULL; 
   }
 
   // Attempt to insert
-  uint8_t result = unordered_map_insert(engine->systems, system->uuid, &system);
+  uint8_t result = engine_add_system(engine, system);
   if (result > 0) { 
     mars_dlog(MARS_VERB_ERROR, "[engine_new_system] Insert failed!\n"); 
+    system_destroy(system);
     return ID_NULL;
   }
   return system->uuid;
@@ -241,13 +817,25 @@ id_t engine_new_system(Engine* engine, size_t component_size, fptr_t init, fptr_
 
 uint8_t engine_add_system(Engine* engine, System* system) {
   // Error check
-  if (!engine) { return 1; }
+  if (!engine || !system) { return 1; }
 
   // Attempt to insert
-  return unordered_map_insert(engine->systems, system->uuid, &system);
+  size_t bit = engine->system_order->length;
+  if (vector_push_back(engine->system_order, &system) > 0) { return 1; }
+  if (unordered_map_insert(engine->systems, system->uuid, &system) > 0) {
+    engine->system_order->length--;
+    return 1;
+  }
+
+  // Hand out component bits in the order systems are added
+  system->bit = (bit < MARS_MAX_COMPONENTS) ? bit : SIZE_MAX;
+  if (engine->profiling && system_set_profiling(system, true) > 0) {
+    mars_dlog(MARS_VERB_WARNING, "[engine_add_system] Failed to profile system!\n");
+  }
+  return 0;
 }
 
-System* engine_get_system(Engine* engine, id_t uuid) {
+System* engine_get_system(Engine* engine, mars_id_t uuid) {
   // Error check
   if (!engine) { return NULL; }
 
@@ -256,36 +844,185 @@ System* engine_get_system(Engine* engine, id_t uuid) {
   return (data) ? (System*)(*data) : NULL;
 }
 
-id_t engine_new_entity(Engine* engine) {
+mars_id_t engine_new_entity(Engine* engine) {
   if (!engine) { return ID_NULL; }
 
-  // Allocate space for entity
-  Entity* entity = entity_create();
-  if (!entity) { return ID_NULL; }
-
-  // Attempt to insert
-  uint8_t result = unordered_map_insert(engine->entities, entity->uuid, &entity);
-  return (result > 0) ? ID_NULL : entity->uuid;
+  // Claim a slot, the handle is only known once it is stored
+  Entity entity = { ID_NULL, NULL, 0, 0 };
+  return (engine_add_entity(engine, &entity) > 0) ? ID_NULL : entity.uuid;
 }
 
 uint8_t engine_add_entity(Engine* engine, Entity* entity) {
   // Error check
-  if (!engine) { return 1; }
+  if (!engine || !entity) { return 1; }
+
+  // Store a copy in the slot array & hand its handle back, it starts without components
+  mars_id_t uuid;
+  if (lot_insert(engine->entities, &uuid, entity) > 0) { return 1; }
+  Entity* stored = lot_find(engine->entities, uuid);
+  stored->uuid = uuid;
+  stored->archetype = NULL;
+  stored->row = 0;
+  stored->signature = 0;
+  entity->uuid = uuid;
+  return 0;
+}
 
-  // Attempt to insert
-  return unordered_map_insert(engine->entities, entity->uuid, &entity);
+Entity* engine_get_entity(Engine* engine, mars_id_t uuid) {
+  // Error check
+  if (!engine || uuid == ID_NULL || (uuid & ID_PENDING)) { return NULL; }
+
+  // Index straight into the slot array, stale handles fail the generation check
+  return lot_find(engine->entities, uuid);
+}
+
+// Cache the archetype in the query if it holds the right components
+static uint8_t engine_query_match(Query* query, Archetype* archetype) {
+  if ((archetype->signature & query->with) != query->with || (archetype->signature & query->without)) { return 0; }
+  QueryMatch match;
+  match.archetype = archetype;
+  for (size_t i = 0; i < query->count; ++i) {
+    match.offsets[i] = vector_get(archetype->offsets, archetype_column(archetype, query->bits[i]), size_t);
+  }
+  return vector_push_back(query->matches, &match);
 }
 
-Entity* engine_get_entity(Engine* engine, id_t uuid) {
+Archetype* engine_get_archetype(Engine* engine, signature_t signature) {
   // Error check
-  if (!engine) { return NULL; }
+  if (!engine || signature == 0) { return NULL; }
+  Archetype** found = unordered_map_find(engine->archetype_index, signature);
+  if (found) { return *found; }
+
+  // Columns follow bit order, every bit must belong to a system
+  void* systems[MARS_MAX_COMPONENTS];
+  size_t count = 0;
+  for (size_t bit = 0; bit < MARS_MAX_COMPONENTS; ++bit) {
+    if (signature & ((signature_t)1 << bit)) {
+      if (bit >= engine->system_order->length) { return NULL; }
+      systems[count++] = vector_get(engine->system_order, bit, System*);
+    }
+  }
+  MARS_TRACE_BEGIN("archetype_create", signature);
+  Archetype* archetype = archetype_create(signature, systems, count, engine->allocator, &engine->chunk_pool->base);
+  MARS_TRACE_END("archetype_create", signature);
+  if (!archetype) { return NULL; }
+  if (vector_push_back(engine->archetypes, &archetype) > 0) {
+    archetype_destroy(archetype);
+    return NULL;
+  }
+  if (unordered_map_insert(engine->archetype_index, signature, &archetype) > 0) {
+    engine->archetypes->length--;
+    archetype_destroy(archetype);
+    return NULL;
+  }
 
-  // Attempt to find
-  void** data = unordered_map_find(engine->entities, uuid);
-  return (data) ? (Entity*)(*data) : NULL;
+  // Let each system find its column when updating, and add it to every query it matches
+  uint8_t result = 0;
+  size_t columns = 0;
+  for (; columns < count && result == 0; ++columns) {
+    ArchetypeColumn column = { archetype, vector_get(archetype->offsets, columns, size_t) };
+    result = vector_push_back(((System*)systems[columns])->columns, &column);
+  }
+  vector_foreach(engine->queries, Query*, query) {
+    if (result > 0) { break; }
+    result = engine_query_match(*query, archetype);
+  }
+  if (result == 0) { return archetype; }
+
+  // Undo on failure, the archetype is the last entry of everything it was added to
+  for (size_t i = 0; i < columns; ++i) {
+    vector* list = ((System*)systems[i])->columns;
+    if (list->length > 0 && ((ArchetypeColumn*)vector_at(list, list->length - 1))->archetype == archetype) { list->length--; }
+  }
+  vector_foreach(engine->queries, Query*, query) {
+    vector* list = (*query)->matches;
+    if (list->length > 0 && ((QueryMatch*)vector_at(list, list->length - 1))->archetype == archetype) { list->length--; }
+  }
+  unordered_map_delete(engine->archetype_index, signature);
+  engine->archetypes->length--;
+  archetype_destroy(archetype);
+  return NULL;
 }
 
-uint8_t engine_new_entity_component(Engine* engine, id_t system_id, id_t entity_id) {
+// Move an entity into the archetype for a signature, carrying over the components both share.
+// Components new to the entity are left uninitialized.
+static uint8_t engine_move_entity(Engine* engine, Entity* entity, signature_t signature) {
+  Archetype* src = entity->archetype;
+  Archetype* dest = NULL;
+  size_t row = 0;
+  if (signature) {
+    dest = engine_get_archetype(engine, signature);
+    if (!dest) { return 1; }
+    row = archetype_push(dest, entity->uuid);
+    if (row == SIZE_MAX) { return 1; }
+
+    // Copy shared components
+    if (src) {
+      for (size_t i = 0; i < dest->systems->length; ++i) {
+        System* system = vector_get(dest->systems, i, System*);
+        size_t column = archetype_column(src, system->bit);
+        if (column != SIZE_MAX) {
+          memcpy(archetype_get(dest, i, row), archetype_get(src, column, entity->row), system->component_size);
+        }
+      }
+    }
+  }
+
+  // Fill the hole left behind
+  if (src) {
+    mars_id_t moved_id = archetype_remove(src, entity->row);
+    if (moved_id != ID_NULL) {
+      ((Entity*)lot_find(engine->entities, moved_id))->row = entity->row;
+    }
+  }
+  entity->archetype = dest;
+  entity->row = row;
+  return 0;
+}
+
+// Give an entity an archetype-stored component, copied from the given data or zeroed
+static uint8_t engine_archetype_add(Engine* engine, System* system, mars_id_t entity_id, void* component) {
+  Entity* entity = engine_get_entity(engine, entity_id);
+  if (!entity) { return 1; }
+
+  // Entities can only hold one component per system
+  signature_t mask = (signature_t)1 << system->bit;
+  signature_t signature = (entity->archetype) ? entity->archetype->signature : 0;
+  if (signature & mask) { return 1; }
+  if (engine_move_entity(engine, entity, signature | mask) > 0) { return 1; }
+
+  // Set up the new component
+  void* dest = archetype_get(entity->archetype, archetype_column(entity->archetype, system->bit), entity->row);
+  if (component) {
+    memcpy(dest, component, system->component_size);
+  }
+  else {
+    memset(dest, 0, system->component_size);
+  }
+  if (system->init) {
+    void* args[] = {dest, &entity_id};
+    system->init(2, args);
+  }
+  return 0;
+}
+
+// Get the archetype-stored component of an entity
+static void* engine_archetype_get(Engine* engine, System* system, mars_id_t entity_id) {
+  Entity* entity = engine_get_entity(engine, entity_id);
+  if (!entity || !entity->archetype) { return NULL; }
+  size_t column = archetype_column(entity->archetype, system->bit);
+  return (column != SIZE_MAX) ? archetype_get(entity->archetype, column, entity->row) : NULL;
+}
+
+// Record whether an entity holds a component of the system in its signature
+static void engine_track(Engine* engine, System* system, mars_id_t entity_id, bool held) {
+  Entity* entity = engine_get_entity(engine, entity_id);
+  if (!entity || system->bit == SIZE_MAX) { return; }
+  signature_t mask = (signature_t)1 << system->bit;
+  entity->signature = (held) ? (entity->signature | mask) : (entity->signature & ~mask);
+}
+
+uint8_t engine_new_entity_component(Engine* engine, mars_id_t system_id, mars_id_t entity_id) {
   // Error check
   if (!engine) { return 1; }
 
@@ -294,10 +1031,48 @@ uint8_t engine_new_entity_component(Engine* engine, id_t system_id, id_t entity_
   if (!system) { return 1; }
 
   // Create component in system for entity
-  return system_new_component(system, entity_id);
+  uint8_t result = (system->storage == MARS_STORAGE_ARCHETYPE) ? engine_archetype_add(engine, system, entity_id, NULL) : system_new_component(system, entity_id);
+  if (result == 0) { engine_track(engine, system, entity_id, true); }
+  return result;
+}
+
+uint8_t engine_add_entity_component(Engine* engine, mars_id_t system_id, mars_id_t entity_id, void* component) {
+  // Error check
+  if (!engine || !component) { return 1; }
+
+  // Get system
+  System* system = engine_get_system(engine, system_id);
+  if (!system) { return 1; }
+
+  // Copy component into system for entity
+  uint8_t result = (system->storage == MARS_STORAGE_ARCHETYPE) ? engine_archetype_add(engine, system, entity_id, component) : system_add_component(system, entity_id, component);
+  if (result == 0) { engine_track(engine, system, entity_id, true); }
+  return result;
+}
+
+uint8_t engine_remove_entity_component(Engine* engine, mars_id_t system_id, mars_id_t entity_id) {
+  // Error check
+  if (!engine) { return 1; }
+
+  // Get system
+  System* system = engine_get_system(engine, system_id);
+  if (!system) { return 1; }
+  if (system->storage != MARS_STORAGE_ARCHETYPE) {
+    uint8_t result = system_remove_component(system, entity_id);
+    if (result == 0) { engine_track(engine, system, entity_id, false); }
+    return result;
+  }
+
+  // Run destroy function, then move the entity to the archetype without the component
+  void* component = engine_archetype_get(engine, system, entity_id);
+  if (!component) { return 1; }
+  system_run_destroy(system, &component, 1);
+  engine_track(engine, system, entity_id, false);
+  Entity* entity = engine_get_entity(engine, entity_id);
+  return engine_move_entity(engine, entity, entity->archetype->signature & ~((signature_t)1 << system->bit));
 }
 
-void* engine_get_entity_component(Engine* engine, id_t system_id, id_t entity_id) {
+void* engine_get_entity_component(Engine* engine, mars_id_t system_id, mars_id_t entity_id) {
   // Error check
   if (!engine) { return NULL; }
 
@@ -305,59 +1080,605 @@ void* engine_get_entity_component(Engine* engine, id_t system_id, id_t entity_id
   System* system = engine_get_system(engine, system_id);
   if (!system) { return NULL; }
 
-  // Create component in system for entity
+  // Get component in system for entity
+  if (system->storage == MARS_STORAGE_ARCHETYPE) {
+    return engine_archetype_get(engine, system, entity_id);
+  }
   return system_get_component(system, entity_id);
 }
 
+uint8_t engine_spawn_entities(Engine* engine, mars_id_t* entities, size_t count, mars_id_t* system_ids, void** prototypes, size_t system_count) {
+  // Error check
+  if (!engine || !entities || (!system_ids && system_count > 0)) { return 1; }
+  if (count == 0) { return 0; }
+
+  // Resolve systems, each may only be listed once
+  signature_t signature = 0;
+  signature_t archetype_signature = 0;
+  for (size_t s = 0; s < system_count; ++s) {
+    System* system = engine_get_system(engine, system_ids[s]);
+    if (!system) {
+      mars_dlog(MARS_VERB_ERROR, "[engine_spawn_entities] System not found!\n");
+      return 1;
+    }
+    for (size_t i = 0; i < s; ++i) {
+      if (system_ids[i] == system_ids[s]) {
+        mars_dlog(MARS_VERB_ERROR, "[engine_spawn_entities] System listed twice!\n");
+        return 1;
+      }
+    }
+    signature |= (system->bit != SIZE_MAX) ? (signature_t)1 << system->bit : 0;
+    archetype_signature |= (system->storage == MARS_STORAGE_ARCHETYPE) ? (signature_t)1 << system->bit : 0;
+  }
+
+  // Reserve everything up front, so filling can't fail halfway
+  if (count > __LOT_MAX_CAPACITY - engine->entities->length) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_spawn_entities] Too many entities for the handle size!\n");
+    return 1;
+  }
+  size_t capacity = engine->entities->__capacity;
+  while (capacity < engine->entities->length + count) { capacity = (capacity < __LOT_MAX_CAPACITY / 2) ? capacity * 2 : __LOT_MAX_CAPACITY; }
+  if (lot_reserve(engine->entities, capacity) > 0) { return 1; }
+  for (size_t s = 0; s < system_count; ++s) {
+    System* system = engine_get_system(engine, system_ids[s]);
+    if (system->storage == MARS_STORAGE_SPARSE &&
+        (system_reserve(system, system->components->length + count) > 0 || vector_reserve(system->sparse, engine->entities->__capacity) > 0)) { return 1; }
+  }
+  Archetype* archetype = NULL;
+  if (archetype_signature) {
+    archetype = engine_get_archetype(engine, archetype_signature);
+    if (!archetype || archetype_reserve(archetype, archetype->length + count) > 0) { return 1; }
+  }
+
+  // Claim the slots & rows
+  MARS_TRACE_BEGIN("engine_spawn_entities", count);
+  Entity entity = { ID_NULL, archetype, 0, signature };
+  size_t first_row = (archetype) ? archetype->length : 0;
+  for (size_t i = 0; i < count; ++i) {
+    lot_insert(engine->entities, &entities[i], &entity);
+    Entity* stored = lot_find(engine->entities, entities[i]);
+    stored->uuid = entities[i];
+    stored->row = (archetype) ? archetype_push(archetype, entities[i]) : 0;
+  }
+
+  // Copy the prototypes into each system's new range, one chunk at a time for archetypes
+  for (size_t s = 0; s < system_count; ++s) {
+    System* system = engine_get_system(engine, system_ids[s]);
+    void* prototype = (prototypes) ? prototypes[s] : NULL;
+    if (system->storage == MARS_STORAGE_ARCHETYPE) {
+      size_t offset = vector_get(archetype->offsets, archetype_column(archetype, system->bit), size_t);
+      for (size_t row = first_row; row < archetype->length;) {
+        size_t chunk_row = row % archetype->chunk_capacity;
+        size_t rows = archetype->chunk_capacity - chunk_row;
+        rows = (rows < archetype->length - row) ? rows : archetype->length - row;
+        uint8_t* base = *(uint8_t**)vector_at(archetype->chunks, row / archetype->chunk_capacity);
+        system_fill(system, base + offset + (chunk_row * system->component_size), rows, prototype, (mars_id_t*)base + chunk_row);
+        row += rows;
+      }
+    }
+    else {
+      size_t first = system->components->length;
+      system->components->length += count;
+      system->entities->length += count;
+      memcpy(vector_at(system->entities, first), entities, sizeof(mars_id_t) * count);
+      for (size_t i = 0; i < count; ++i) {
+        entity_sparse_set(&system->sparse, entities[i], first + i);
+      }
+      system_fill(system, vector_at(system->components, first), count, prototype, entities);
+    }
+  }
+  MARS_TRACE_END("engine_spawn_entities", count);
+  return 0;
+}
+
+uint8_t engine_destroy_entity(Engine* engine, mars_id_t entity_id) {
+  // Error check
+  if (!engine_get_entity(engine, entity_id)) { return 1; }
+  return engine_destroy_entities(engine, &entity_id, 1);
+}
+
+// Order handles by slot so storage is visited front to back
+static int engine_compare_slots(const void* a, const void* b) {
+  size_t x = entity_index(*(const mars_id_t*)a), y = entity_index(*(const mars_id_t*)b);
+  return (x < y) ? -1 : (x > y);
+}
+
+uint8_t engine_destroy_entities(Engine* engine, mars_id_t* entity_ids, size_t count) {
+  // Error check
+  if (!engine || (!entity_ids && count > 0)) { return 1; }
+
+  // Keep the live handles, sorted by slot & without repeats
+  engine->destroy_list->length = 0;
+  for (size_t i = 0; i < count; ++i) {
+    Entity* entity = engine_get_entity(engine, entity_ids[i]);
+    if (entity && vector_push_back(engine->destroy_list, &entity_ids[i]) > 0) { return 1; }
+  }
+  mars_id_t* list = vector_data(engine->destroy_list);
+  qsort(list, engine->destroy_list->length, sizeof(mars_id_t), engine_compare_slots);
+  size_t unique = 0;
+  for (size_t i = 0; i < engine->destroy_list->length; ++i) {
+    if (unique == 0 || list[unique - 1] != list[i]) { list[unique++] = list[i]; }
+  }
+  engine->destroy_list->length = unique;
+  if (unique == 0) { return 0; }
+
+  // Bucket the doomed components by system, so each destroy function runs over all of its
+  // components in one pass. Every pointer is gathered before any destroy function runs.
+  MARS_TRACE_BEGIN("engine_destroy_entities", unique);
+  System** order = vector_data(engine->system_order);
+  size_t starts[MARS_MAX_COMPONENTS + 1] = {0};
+  for (size_t i = 0; i < unique; ++i) {
+    signature_t signature = engine_get_entity(engine, list[i])->signature;
+    for (size_t bit = 0; bit < MARS_MAX_COMPONENTS && (signature >> bit); ++bit) {
+      starts[bit + 1] += ((signature >> bit) & 1 && (order[bit]->destroy || order[bit]->destroy_batch));
+    }
+  }
+  for (size_t bit = 0; bit < MARS_MAX_COMPONENTS; ++bit) {
+    starts[bit + 1] += starts[bit];
+  }
+  if (starts[MARS_MAX_COMPONENTS] > engine->destroy_components->__capacity) {
+    vector* temp = __vec_resize(engine->destroy_components, starts[MARS_MAX_COMPONENTS]);
+    if (!temp) {
+      MARS_TRACE_END("engine_destroy_entities", unique);
+      return 1;
+    }
+    engine->destroy_components = temp;
+  }
+  void** components = vector_data(engine->destroy_components);
+  size_t ends[MARS_MAX_COMPONENTS];
+  memcpy(ends, starts, sizeof(ends));
+  for (size_t i = 0; i < unique; ++i) {
+    Entity* entity = engine_get_entity(engine, list[i]);
+    for (size_t bit = 0; bit < MARS_MAX_COMPONENTS && (entity->signature >> bit); ++bit) {
+      System* system = order[bit];
+      if (!((entity->signature >> bit) & 1) || !(system->destroy || system->destroy_batch)) { continue; }
+      void* component = (system->storage == MARS_STORAGE_ARCHETYPE) ?
+        archetype_get(entity->archetype, archetype_column(entity->archetype, bit), entity->row) : system_get_component(system, list[i]);
+      if (component) { components[ends[bit]++] = component; }
+    }
+  }
+  for (size_t bit = 0; bit < MARS_MAX_COMPONENTS && bit < engine->system_order->length; ++bit) {
+    system_run_destroy(order[bit], components + starts[bit], ends[bit] - starts[bit]);
+  }
+
+  // Release the storage, the freed rows & slots are reused by later inserts
+  for (size_t i = 0; i < unique; ++i) {
+    Entity* entity = engine_get_entity(engine, list[i]);
+    signature_t signature = entity->signature;
+    for (size_t bit = 0; bit < MARS_MAX_COMPONENTS && (signature >> bit); ++bit) {
+      size_t index = ((signature >> bit) & 1 && order[bit]->storage == MARS_STORAGE_SPARSE) ? system_find(order[bit], list[i]) : SIZE_MAX;
+      if (index != SIZE_MAX) {
+        system_erase(order[bit], index);
+      }
+    }
+    if (entity->archetype) {
+      engine_move_entity(engine, entity, 0);
+    }
+
+    // Systems past the signature width are not tracked & have to be probed
+    for (size_t s = MARS_MAX_COMPONENTS; s < engine->system_order->length; ++s) {
+      system_remove_component(order[s], list[i]);
+    }
+    lot_delete(engine->entities, list[i]);
+  }
+  MARS_TRACE_END("engine_destroy_entities", unique);
+  return 0;
+}
+
+uint8_t engine_set_system_storage(Engine* engine, mars_id_t system_id, uint8_t storage) {
+  // Error check
+  if (!engine) { return 1; }
+  System* system = engine_get_system(engine, system_id);
+  if (!system || storage > MARS_STORAGE_ARCHETYPE) { return 1; }
+
+  // Components can't be carried between storage modes
+  if (system->components->length > 0 || system->columns->length > 0) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_set_system_storage] System already holds components!\n");
+    return 1;
+  }
+  if (storage == MARS_STORAGE_ARCHETYPE && system->bit == SIZE_MAX) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_set_system_storage] Out of component bits!\n");
+    return 1;
+  }
+  system->storage = storage;
+  return 0;
+}
+
+void engine_archetype_iter(Engine* engine, ArchetypeIter* it, mars_id_t* systems, size_t count) {
+  // Error check
+  if (!it) { return; }
+  it->length = 0;
+  it->entities = NULL;
+  it->__archetypes = NULL;
+  it->__query = NULL;
+  it->__archetype = 0;
+  it->__chunk = 0;
+  it->__count = 0;
+  it->__signature = 0;
+  if (!engine || count > MARS_ITER_COMPONENTS) { return; }
+
+  // Build the signature every matching archetype must contain
+  for (size_t i = 0; i < count; ++i) {
+    System* system = engine_get_system(engine, systems[i]);
+    if (!system || system->storage != MARS_STORAGE_ARCHETYPE) {
+      mars_dlog(MARS_VERB_ERROR, "[engine_archetype_iter] System does not use archetype storage!\n");
+      return;
+    }
+    it->__bits[i] = system->bit;
+    it->__signature |= (signature_t)1 << system->bit;
+  }
+  it->__archetypes = engine->archetypes;
+  it->__count = count;
+  archetype_iter_next(it);
+}
+
+// Resolve systems to archetype component bits
+static uint8_t engine_query_bits(Engine* engine, mars_id_t* systems, size_t count, size_t* bits, signature_t* signature) {
+  for (size_t i = 0; i < count; ++i) {
+    System* system = engine_get_system(engine, systems[i]);
+    if (!system || system->storage != MARS_STORAGE_ARCHETYPE) {
+      mars_dlog(MARS_VERB_ERROR, "[engine_new_query] System does not use archetype storage!\n");
+      return 1;
+    }
+    if (bits) { bits[i] = system->bit; }
+    *signature |= (signature_t)1 << system->bit;
+  }
+  return 0;
+}
+
+Query* engine_new_query(Engine* engine, mars_id_t* with, size_t with_count, mars_id_t* without, size_t without_count) {
+  // Error check
+  if (!engine || with_count > MARS_ITER_COMPONENTS || (with_count > 0 && !with) || (without_count > 0 && !without)) { return NULL; }
+
+  // Assign default values
+  Query* query = allocator_alloc(engine->allocator, sizeof(*query));
+  if (!query) { return NULL; }
+  query->with = 0;
+  query->without = 0;
+  query->count = with_count;
+  query->matches = vector_create_alloc(QueryMatch, engine->allocator);
+  if (!query->matches ||
+      engine_query_bits(engine, with, with_count, query->bits, &query->with) > 0 ||
+      engine_query_bits(engine, without, without_count, NULL, &query->without) > 0 ||
+      vector_push_back(engine->queries, &query) > 0) {
+    vector_destroy(query->matches);
+    allocator_free(engine->allocator, query, sizeof(*query));
+    return NULL;
+  }
+
+  // Match the archetypes that already exist, later ones are matched as they are created
+  vector_foreach(engine->archetypes, Archetype*, archetype) {
+    if (engine_query_match(query, *archetype) > 0) {
+      engine_destroy_query(engine, query);
+      return NULL;
+    }
+  }
+  return query;
+}
+
+void engine_destroy_query(Engine* engine, Query* query) {
+  // Error check
+  if (!engine || !query) { return; }
+
+  // Stop matching new archetypes
+  Query** queries = vector_data(engine->queries);
+  for (size_t i = 0; i < engine->queries->length; ++i) {
+    if (queries[i] == query) {
+      vector_remove(engine->queries, i);
+      break;
+    }
+  }
+  vector_destroy(query->matches);
+  allocator_free(engine->allocator, query, sizeof(*query));
+}
+
+uint8_t engine_set_threads(Engine* engine, size_t thread_count) {
+  // Error check
+  if (!engine) { return 1; }
+
+  // Replace the existing pool, applying anything recorded for the old one
+  engine_flush(engine);
+  thread_pool_destroy(engine->pool);
+  engine->pool = NULL;
+  if (thread_count > 0) {
+    engine->pool = thread_pool_create(thread_count);
+    if (!engine->pool) {
+      mars_dlog(MARS_VERB_ERROR, "[engine_set_threads] Failed to create thread pool!\n");
+    }
+  }
+
+  // One command buffer & pair of frame arenas for the calling thread & each worker
+  size_t count = (engine->pool) ? engine->pool->thread_count + 1 : 1;
+  if (engine_command_buffers(engine, count) > 0) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_set_threads] Failed to create command buffers!\n");
+    return 1;
+  }
+  if (engine_frame_arenas(engine, count) > 0) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_set_threads] Failed to create frame arenas!\n");
+    return 1;
+  }
+  return (thread_count > 0 && !engine->pool) ? 1 : 0;
+}
+
+void* engine_frame_alloc(Engine* engine, size_t size) {
+  allocator* frame = engine_frame_allocator(engine);
+  return (frame) ? allocator_alloc(frame, size) : NULL;
+}
+
+allocator* engine_frame_allocator(Engine* engine) {
+  // Error check
+  size_t index = mars_thread_index();
+  if (!engine || index >= engine->frame_count) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_frame_allocator] No frame arena for this thread!\n");
+    return NULL;
+  }
+  return &engine->frames[(index * 2) + engine->frame]->base;
+}
+
+uint8_t engine_reserve(Engine* engine, size_t entity_count) {
+  // Error check
+  if (!engine) { return 1; }
+
+  // Slots, plus a sparse entry per slot so adding components never grows the index
+  if (lot_reserve(engine->entities, entity_count) > 0) { return 1; }
+  vector_foreach(engine->system_order, System*, system) {
+    if ((*system)->storage == MARS_STORAGE_SPARSE && vector_reserve((*system)->sparse, entity_count) > 0) { return 1; }
+  }
+  return 0;
+}
+
+uint8_t engine_shrink_to_fit(Engine* engine) {
+  // Error check
+  if (!engine) { return 1; }
+
+  // Entity slots, systems & archetype chunks
+  uint8_t result = lot_shrink_to_fit(engine->entities);
+  vector_foreach(engine->system_order, System*, system) {
+    result |= system_shrink_to_fit(*system);
+  }
+  vector_foreach(engine->archetypes, Archetype*, archetype) {
+    archetype_shrink_to_fit(*archetype);
+  }
+  result |= unordered_map_shrink_to_fit(engine->systems);
+  result |= unordered_map_shrink_to_fit(engine->archetype_index);
+
+  // Command buffers & scratch lists grow back on demand
+  for (size_t i = 0; i < engine->command_count; ++i) {
+    result |= vector_shrink_to_fit(engine->commands[i].commands);
+    result |= vector_shrink_to_fit(engine->commands[i].data);
+    result |= vector_shrink_to_fit(engine->commands[i].created);
+  }
+  result |= vector_shrink_to_fit(engine->command_sort);
+  result |= vector_shrink_to_fit(engine->destroy_list);
+  result |= vector_shrink_to_fit(engine->destroy_components);
+  return result;
+}
+
+// Sort systems into phases, placing each system one phase after the last earlier system it conflicts with
+static void engine_schedule(Engine* engine) {
+  System** order = vector_data(engine->system_order);
+  size_t count = engine->system_order->length;
+  engine->schedule->length = 0;
+  engine->schedule_phase->length = 0;
+  for (size_t i = 0; i < count; ++i) {
+    // Find phase
+    size_t phase = 0;
+    System** scheduled = vector_data(engine->schedule);
+    size_t* phases = vector_data(engine->schedule_phase);
+    for (size_t j = 0; j < engine->schedule->length; ++j) {
+      if (phases[j] >= phase && system_conflicts(order[i], scheduled[j])) {
+        phase = phases[j] + 1;
+      }
+    }
+
+    // Insert after every system in the same or an earlier phase (stable)
+    size_t pos = engine->schedule->length;
+    while (pos > 0 && phases[pos - 1] > phase) { pos--; }
+    vector_insert(engine->schedule, pos, &order[i]);
+    vector_insert(engine->schedule_phase, pos, &phase);
+  }
+}
+
+// Update a system, timing it if profiled
+static void engine_run_system(System* system, float* dt, ThreadPool* pool) {
+  if (!system->profile) {
+    MARS_TRACE_BEGIN("system_update", system->uuid);
+    system_update_parallel(system, dt, pool);
+    MARS_TRACE_END("system_update", system->uuid);
+    return;
+  }
+  size_t chunks;
+  size_t count = system_length(system, &chunks);
+  uint64_t start = mars_time_ns();
+  MARS_TRACE_BEGIN("system_update", system->uuid);
+  system_update_parallel(system, dt, pool);
+  MARS_TRACE_END("system_update", system->uuid);
+  profile_record(system->profile, start, mars_time_ns(), count);
+}
+
+// Job wrapper around engine_run_system
+static uint8_t engine_system_job(size_t num, void** args) {
+  engine_run_system((System*)args[0], (float*)args[1], (ThreadPool*)args[2]);
+  return 0;
+}
+
+// Update every system once, running conflict-free phases in parallel
+static void engine_update_systems(Engine* engine) {
+  if (!engine->pool) {
+    // Single threaded, in order
+    vector_foreach(engine->system_order, System*, system) {
+      engine_run_system(*system, &(engine->dt), NULL);
+    }
+    return;
+  }
+
+  // Rebuild the dependency graph
+  engine_schedule(engine);
+  System** scheduled = vector_data(engine->schedule);
+  size_t* phases = vector_data(engine->schedule_phase);
+  size_t count = engine->schedule->length;
+  size_t start = 0;
+  while (start < count) {
+    // Find the end of the phase
+    size_t end = start + 1;
+    while (end < count && phases[end] == phases[start]) { end++; }
+
+    // Hand every system but the first to the pool, then help out
+    volatile size_t pending = 0;
+    for (size_t i = start + 1; i < end; ++i) {
+      void* args[] = {scheduled[i], &(engine->dt), engine->pool};
+      if (thread_pool_submit(engine->pool, engine_system_job, 3, args, &pending) > 0) {
+        engine_run_system(scheduled[i], &(engine->dt), engine->pool);
+      }
+    }
+    engine_run_system(scheduled[start], &(engine->dt), engine->pool);
+    thread_pool_wait(engine->pool, &pending);
+    start = end;
+  }
+}
+
+uint8_t engine_set_loop_mode(Engine* engine, uint8_t mode) {
+  // Error check
+  if (!engine || mode > MARS_LOOP_MAX_SPEED) { return 1; }
+  engine->loop_mode = mode;
+  return 0;
+}
+
+uint8_t engine_set_catch_up(Engine* engine, size_t max_steps, float max_accum, bool dilate) {
+  // Error check
+  if (!engine || max_accum < 0.0f) { return 1; }
+  engine->max_steps = max_steps;
+  engine->max_accum = max_accum;
+  engine->dilate = dilate;
+  return 0;
+}
+
+void engine_step(Engine* engine) {
+  // Error check
+  if (!engine) { return; }
+
+  // Update systems, apply the structural changes they recorded & start the next frame
+  uint64_t start = (engine->profile) ? mars_time_ns() : 0;
+  MARS_TRACE_BEGIN("engine_step", engine->step);
+  engine_update_systems(engine);
+  engine_flush(engine);
+  engine_next_frame(engine);
+  MARS_TRACE_END("engine_step", engine->step);
+  engine->step++;
+  if (engine->profile) {
+    profile_record(engine->profile, start, mars_time_ns(), engine->entities->length);
+  }
+}
+
 void engine_update(Engine* engine) {
   while(engine->run) {
+    // Step back to back without looking at the clock
+    if (engine->loop_mode == MARS_LOOP_MAX_SPEED) {
+      engine_step(engine);
+      engine->render_alpha = 0.0f;
+      mars_trace_flush();
+      continue;
+    }
+
     // Get frame time
-    gettimeofday(&(engine->new_time), 0);
-    long int sec = engine->new_time.tv_sec - engine->old_time.tv_sec;
-    long int usec = engine->new_time.tv_usec - engine->old_time.tv_usec;
-    engine->time_accum += sec+(usec*0.000001f);
-    engine->old_time = engine->new_time;
+    uint64_t now = mars_time_ns();
+    engine->time_accum += (float)((double)(now - engine->old_time) * 1e-9);
+    engine->old_time = now;
+    EngineLoopStats* stats = &engine->loop_stats;
+    if (engine->max_accum > 0.0f && engine->time_accum > engine->max_accum) {
+      stats->clamps++;
+      stats->dropped += engine->time_accum - engine->max_accum;
+      engine->time_accum = engine->max_accum;
+    }
 
     // Consume frame time in discrete dt-sized bits
+    MARS_TRACE_BEGIN("engine_update", engine->loop_stats.frames);
+    size_t steps = 0;
     while (engine->time_accum >= engine->dt) {
-      // Update systems
-      for(umap_it_t* it = unordered_map_it(engine->systems); it; unordered_map_it_next(it)) {
-        system_update(*(System**)(it->data), &(engine->dt));
+      // Stop at the cap, dropping whole steps when dilating
+      if (engine->max_steps > 0 && steps == engine->max_steps) {
+        stats->overruns++;
+        if (engine->dilate) {
+          float skipped = (float)(size_t)(engine->time_accum / engine->dt) * engine->dt;
+          stats->dropped += skipped;
+          engine->time_accum -= skipped;
+        }
+        break;
       }
+      engine_step(engine);
 
       // Reduce remaining time
       engine->time_accum -= engine->dt;
+      steps++;
     }
+    stats->frames++;
+    stats->steps += steps;
+    stats->last_steps = steps;
+    stats->max_steps = (steps > stats->max_steps) ? steps : stats->max_steps;
+    MARS_TRACE_END("engine_update", stats->frames - 1);
+    mars_trace_flush();
 
     // Normalize remaining time
-    engine->render_alpha = engine->time_accum / engine->dt;
+    engine->render_alpha = (engine->time_accum < engine->dt) ? engine->time_accum / engine->dt : 1.0f;
 
     // Update renderer state
     // TODO
+
+    // Wait for the next step to come due
+    if (engine->loop_mode == MARS_LOOP_SLEEP && engine->run && engine->time_accum < engine->dt) {
+      mars_sleep_until(now + (uint64_t)((double)(engine->dt - engine->time_accum) * 1e9));
+    }
   }
 }
 
 void engine_destroy(Engine* engine) {
   if (engine) {
+    // Stop profiling
+    engine_set_profiling(engine, false);
+
+    // Stop worker threads
+    thread_pool_destroy(engine->pool);
+
     // Iterate through systems
-    for(umap_it_t* it = unordered_map_it(engine->systems); it; unordered_map_it_next(it)) {
-      system_destroy(*(System**)it->data);
+    vector_foreach(engine->system_order, System*, system) {
+      system_destroy(*system);
     }
 
-    // Destroy system map
+    // Destroy system containers
     unordered_map_destroy(engine->systems);
-
-    // Iterate through entities
-    for(umap_it_t* it = unordered_map_it(engine->entities); it; unordered_map_it_next(it)) {
-      entity_destroy(*(Entity**)it->data);
+    vector_destroy(engine->system_order);
+    vector_destroy(engine->schedule);
+    vector_destroy(engine->schedule_phase);
+
+    // Destroy queries
+    vector_foreach(engine->queries, Query*, query) {
+      vector_destroy((*query)->matches);
+      allocator_free(engine->allocator, *query, sizeof(**query));
     }
+    vector_destroy(engine->queries);
 
-    // Destroy entity map
-    unordered_map_destroy(engine->entities);
+    // Destroy archetype tables, their components were destroyed with their systems
+    vector_foreach(engine->archetypes, Archetype*, archetype) {
+      archetype_destroy(*archetype);
+    }
+    vector_destroy(engine->archetypes);
+    unordered_map_destroy(engine->archetype_index);
+    pool_allocator_destroy(engine->chunk_pool);
+
+    // Destroy entity slots & unapplied commands
+    lot_destroy(engine->entities);
+    engine_command_buffers(engine, 0);
+    engine_frame_arenas(engine, 0);
+    vector_destroy(engine->command_sort);
+    vector_destroy(engine->destroy_list);
+    vector_destroy(engine->destroy_components);
+
+    // Release the snapshot the loaded containers lived in
+    mars_unmap_file(engine->snapshot, engine->snapshot_size);
+
+    // Destroy struct
+    engine_free(engine);
   }
-
-  // Destroy struct
-  free(engine);
 }
 
 
@@ -369,10 +1690,45 @@ Entity* entity_create() {
   // Assign default values
   Entity* entity = malloc(sizeof(*entity));
   if (!entity) { return NULL; }
-  entity->uuid = uuid_generate();
+  entity->uuid = ID_NULL;
+  entity->archetype = NULL;
+  entity->row = 0;
+  entity->signature = 0;
   return entity;
 }
 
 void entity_destroy(Entity* entity) {
   free(entity);
+}
+
+size_t entity_sparse_find(vector* sparse, const mars_id_t* dense, size_t length, mars_id_t entity_id) {
+  // Error check
+  size_t slot = entity_index(entity_id);
+  if (!sparse || slot >= sparse->length) { return SIZE_MAX; }
+
+  // The packed entry must belong to this exact handle, not an older one in the same slot
+  size_t index = *(size_t*)vector_at(sparse, slot);
+  return (index < length && dense[index] == entity_id) ? index : SIZE_MAX;
+}
+
+uint8_t entity_sparse_set(vector** sparse, mars_id_t entity_id, size_t index) {
+  // Error check
+  if (!sparse || !(*sparse)) { return 1; }
+
+  // Grow to cover the slot, filling the gap with empty entries
+  size_t slot = entity_index(entity_id);
+  if (slot >= (*sparse)->length) {
+    if (index == SIZE_MAX) { return 0; }
+    if (slot >= (*sparse)->__capacity) {
+      size_t capacity = (*sparse)->__capacity;
+      while (capacity <= slot) { capacity *= 2; }
+      vector* temp = __vec_resize(*sparse, capacity);
+      if (!temp) { return 1; }
+      (*sparse) = temp;
+    }
+    memset(vector_at(*sparse, (*sparse)->length), 0xFF, sizeof(size_t) * (slot + 1 - (*sparse)->length));
+    (*sparse)->length = slot + 1;
+  }
+  *(size_t*)vector_at(*sparse, slot) = index;
+  return 0;
 }
\ No newline at end of file
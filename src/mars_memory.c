@@ -0,0 +1,145 @@
+#ifndef MARS_EXPORTS
+  #define MARS_EXPORTS
+#endif
+#include "mars/mars_core.h"
+
+/*=======================================================*/
+/* Definitions                                           */
+/*=======================================================*/
+
+// Add a block that is allocated once & never resized
+static void memory_add_block(container_stats* stats, size_t bytes) {
+  if (bytes > 0) {
+    __container_stats_add(stats, bytes, bytes, 0);
+  }
+}
+
+static void memory_add_vector(container_stats* stats, vector* vec) {
+  if (vec) { vector_stats(vec, stats); }
+}
+
+// Add everything a system allocated itself: its struct, storage, scratch buffers & profile
+static void memory_add_system(container_stats* stats, System* system) {
+  memory_add_block(stats, sizeof(System));
+  memory_add_vector(stats, system->sparse);
+  memory_add_vector(stats, system->components);
+  memory_add_vector(stats, system->entities);
+  memory_add_vector(stats, system->reads);
+  memory_add_vector(stats, system->writes);
+  memory_add_vector(stats, system->columns);
+  memory_add_block(stats, system->scratch_size * system->scratch_count);
+  if (system->profile) { memory_add_block(stats, sizeof(Profile)); }
+}
+
+// Add an archetype's struct & lists, its chunks are counted by the chunk pool
+static void memory_add_archetype(container_stats* stats, Archetype* archetype) {
+  memory_add_block(stats, sizeof(Archetype));
+  memory_add_vector(stats, archetype->systems);
+  memory_add_vector(stats, archetype->offsets);
+  memory_add_vector(stats, archetype->chunks);
+}
+
+// Add the slabs & large blocks an allocator holds, counting each block handed out as an allocation
+static void memory_add_allocator(container_stats* stats, size_t size, AllocatorStats* allocator_stats) {
+  AllocatorStats copy = allocator_stats_get(allocator_stats);
+  stats->bytes += size + copy.reserved;
+  stats->peak += size + copy.reserved;
+  stats->allocs += 1 + copy.allocs;
+}
+
+
+/*=======================================================*/
+/* System                                                */
+/*=======================================================*/
+
+uint8_t system_memory(System* system, container_stats* stats) {
+  // Error check
+  if (!system || !stats) { return 1; }
+  container_stats empty = { 0 };
+  *stats = empty;
+  memory_add_system(stats, system);
+
+  // Rows of the archetype columns holding its components, including free rows of the last chunk
+  if (system->columns) {
+    vector_foreach(system->columns, ArchetypeColumn, column) {
+      Archetype* archetype = column->archetype;
+      size_t bytes = archetype->chunks->length * archetype->chunk_capacity * system->component_size;
+      stats->bytes += bytes;
+      stats->peak += bytes;
+    }
+  }
+  return 0;
+}
+
+
+/*=======================================================*/
+/* Engine                                                */
+/*=======================================================*/
+
+uint8_t engine_system_memory(Engine* engine, mars_id_t system_id, container_stats* stats) {
+  // Error check
+  System* system = engine_get_system(engine, system_id);
+  if (!system) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_system_memory] System does not exist!\n");
+    return 1;
+  }
+  return system_memory(system, stats);
+}
+
+uint8_t engine_memory(Engine* engine, container_stats* stats) {
+  // Error check
+  if (!engine || !stats) { return 1; }
+  container_stats empty = { 0 };
+  *stats = empty;
+
+  // Engine tables
+  memory_add_block(stats, sizeof(Engine));
+  if (engine->profile) { memory_add_block(stats, sizeof(Profile)); }
+  unordered_map_stats(engine->systems, stats);
+  lot_stats(engine->entities, stats);
+  memory_add_vector(stats, engine->system_order);
+  memory_add_vector(stats, engine->schedule);
+  memory_add_vector(stats, engine->schedule_phase);
+  memory_add_vector(stats, engine->archetypes);
+  unordered_map_stats(engine->archetype_index, stats);
+  memory_add_vector(stats, engine->queries);
+  memory_add_vector(stats, engine->command_sort);
+  memory_add_vector(stats, engine->destroy_list);
+  memory_add_vector(stats, engine->destroy_components);
+
+  // Systems, archetypes & the chunks they share
+  vector_foreach(engine->system_order, System*, system) {
+    memory_add_system(stats, *system);
+  }
+  vector_foreach(engine->archetypes, Archetype*, archetype) {
+    memory_add_archetype(stats, *archetype);
+  }
+  if (engine->chunk_pool) {
+    memory_add_allocator(stats, sizeof(PoolAllocator), &engine->chunk_pool->stats);
+  }
+
+  // Queries
+  vector_foreach(engine->queries, Query*, query) {
+    memory_add_block(stats, sizeof(Query));
+    memory_add_vector(stats, (*query)->matches);
+  }
+
+  // Per-thread command buffers & frame arenas
+  memory_add_block(stats, sizeof(CommandBuffer) * engine->command_capacity);
+  for (size_t i = 0; i < engine->command_count; ++i) {
+    memory_add_vector(stats, engine->commands[i].commands);
+    memory_add_vector(stats, engine->commands[i].data);
+    memory_add_vector(stats, engine->commands[i].created);
+  }
+  memory_add_block(stats, sizeof(FrameArena*) * engine->frame_capacity * 2);
+  for (size_t i = 0; i < engine->frame_count * 2; ++i) {
+    memory_add_allocator(stats, sizeof(FrameArena), &engine->frames[i]->stats);
+  }
+
+  // Worker threads
+  if (engine->pool) {
+    memory_add_block(stats, sizeof(ThreadPool) + (sizeof(mars_thread_t) * engine->pool->thread_count));
+    memory_add_vector(stats, engine->pool->jobs);
+  }
+  return 0;
+}
\ No newline at end of file
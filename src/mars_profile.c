@@ -0,0 +1,165 @@
+#ifndef MARS_EXPORTS
+  #define MARS_EXPORTS
+#endif
+#include "mars/mars_core.h"
+
+/*=======================================================*/
+/* Definitions                                           */
+/*=======================================================*/
+
+// Order wall times from shortest to longest
+static int profile_compare(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// Allocate an empty profile
+static Profile* profile_create(allocator* alloc) {
+  Profile* profile = allocator_alloc(alloc, sizeof(*profile));
+  if (!profile) { return NULL; }
+  profile->ticks = 0;
+  profile->total = 0;
+  profile->peak = 0;
+  return profile;
+}
+
+// Write one set of statistics as a JSON object or CSV row
+static void profile_write(FILE* file, uint8_t format, const char* kind, unsigned long long id, ProfileStats* stats) {
+  if (format == MARS_PROFILE_JSON) {
+    fprintf(file, "{\"kind\":\"%s\",\"id\":%llu,\"ticks\":%zu,\"last_ns\":%llu,\"mean_ns\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+      "\"max_ns\":%llu,\"peak_ns\":%llu,\"components\":%zu,\"calls_per_sec\":%.2f}",
+      kind, id, stats->ticks, (unsigned long long)stats->last_ns, stats->mean_ns, (unsigned long long)stats->p50_ns,
+      (unsigned long long)stats->p99_ns, (unsigned long long)stats->max_ns, (unsigned long long)stats->peak_ns,
+      stats->components, stats->calls_per_sec);
+  }
+  else {
+    fprintf(file, "%s,%llu,%zu,%llu,%.1f,%llu,%llu,%llu,%llu,%zu,%.2f\n",
+      kind, id, stats->ticks, (unsigned long long)stats->last_ns, stats->mean_ns, (unsigned long long)stats->p50_ns,
+      (unsigned long long)stats->p99_ns, (unsigned long long)stats->max_ns, (unsigned long long)stats->peak_ns,
+      stats->components, stats->calls_per_sec);
+  }
+}
+
+
+/*=======================================================*/
+/* Profile                                               */
+/*=======================================================*/
+
+uint8_t profile_stats(Profile* profile, ProfileStats* stats) {
+  // Error check
+  if (!profile || !stats) { return 1; }
+  ProfileStats empty = { 0 };
+  *stats = empty;
+  stats->ticks = profile->ticks;
+  stats->peak_ns = profile->peak;
+  if (profile->ticks == 0) { return 0; }
+
+  // Sort the wall times in the window
+  size_t count = (profile->ticks < MARS_PROFILE_WINDOW) ? profile->ticks : MARS_PROFILE_WINDOW;
+  size_t newest = (profile->ticks - 1) % MARS_PROFILE_WINDOW;
+  size_t oldest = (profile->ticks - count) % MARS_PROFILE_WINDOW;
+  uint64_t durations[MARS_PROFILE_WINDOW];
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; ++i) {
+    durations[i] = profile->samples[i].duration;
+    sum += durations[i];
+  }
+  qsort(durations, count, sizeof(uint64_t), profile_compare);
+
+  // Summarize
+  stats->last_ns = profile->samples[newest].duration;
+  stats->components = profile->samples[newest].count;
+  stats->mean_ns = (double)sum / (double)count;
+  stats->p50_ns = durations[((count - 1) * 50) / 100];
+  stats->p99_ns = durations[((count - 1) * 99) / 100];
+  stats->max_ns = durations[count - 1];
+  uint64_t span = profile->samples[newest].start - profile->samples[oldest].start;
+  stats->calls_per_sec = (span > 0) ? (double)(count - 1) * 1e9 / (double)span : 0.0;
+  return 0;
+}
+
+uint8_t system_set_profiling(System* system, bool enable) {
+  // Error check
+  if (!system) { return 1; }
+
+  // Allocate or free the samples
+  if (enable && !system->profile) {
+    system->profile = profile_create(system->allocator);
+    if (!system->profile) { return 1; }
+  }
+  else if (!enable && system->profile) {
+    allocator_free(system->allocator, system->profile, sizeof(Profile));
+    system->profile = NULL;
+  }
+  return 0;
+}
+
+
+/*=======================================================*/
+/* Engine                                                */
+/*=======================================================*/
+
+uint8_t engine_set_profiling(Engine* engine, bool enable) {
+  // Error check
+  if (!engine) { return 1; }
+
+  // Engine step
+  engine->profiling = enable;
+  if (enable && !engine->profile) {
+    engine->profile = profile_create(engine->allocator);
+    if (!engine->profile) { return 1; }
+  }
+  else if (!enable && engine->profile) {
+    allocator_free(engine->allocator, engine->profile, sizeof(Profile));
+    engine->profile = NULL;
+  }
+
+  // Every system
+  uint8_t result = 0;
+  vector_foreach(engine->system_order, System*, system) {
+    result |= system_set_profiling(*system, enable);
+  }
+  return result;
+}
+
+uint8_t engine_system_profile(Engine* engine, mars_id_t system_id, ProfileStats* stats) {
+  // Error check
+  System* system = engine_get_system(engine, system_id);
+  if (!system || !system->profile) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_system_profile] System is not profiled!\n");
+    return 1;
+  }
+  return profile_stats(system->profile, stats);
+}
+
+uint8_t engine_profile_dump(Engine* engine, FILE* file, uint8_t format) {
+  // Error check
+  if (!engine || !file || format > MARS_PROFILE_CSV || !engine->profile) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_profile_dump] Engine is not profiled!\n");
+    return 1;
+  }
+
+  // Engine step first, then every profiled system in the order they were added
+  ProfileStats stats;
+  profile_stats(engine->profile, &stats);
+  if (format == MARS_PROFILE_JSON) {
+    fprintf(file, "{\"step\":");
+    profile_write(file, format, "step", 0, &stats);
+    fprintf(file, ",\"systems\":[");
+  }
+  else {
+    fprintf(file, "kind,id,ticks,last_ns,mean_ns,p50_ns,p99_ns,max_ns,peak_ns,components,calls_per_sec\n");
+    profile_write(file, format, "step", 0, &stats);
+  }
+  bool first = true;
+  vector_foreach(engine->system_order, System*, system) {
+    if (!(*system)->profile) { continue; }
+    profile_stats((*system)->profile, &stats);
+    if (format == MARS_PROFILE_JSON && !first) { fprintf(file, ","); }
+    profile_write(file, format, "system", (unsigned long long)(*system)->uuid, &stats);
+    first = false;
+  }
+  if (format == MARS_PROFILE_JSON) { fprintf(file, "]}\n"); }
+  return (ferror(file)) ? 1 : 0;
+}
\ No newline at end of file
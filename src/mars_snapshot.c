@@ -0,0 +1,423 @@
+#ifndef MARS_EXPORTS
+  #define MARS_EXPORTS
+#endif
+#include "mars/mars_core.h"
+#include "mars/mars_trace.h"
+
+/*=======================================================*/
+/* Definitions                                           */
+/*=======================================================*/
+
+#define snapshot_align(x) (((x) + (MARS_SNAPSHOT_ALIGN - 1)) & ~(uint64_t)(MARS_SNAPSHOT_ALIGN - 1))
+#define SNAPSHOT_STAGE 16384  // Size (in bytes) of the buffer entity slots are patched in while saving
+
+// Whether a block lives inside the engine's mapped snapshot
+static bool snapshot_owns(Engine* engine, void* ptr) {
+  uintptr_t start = (uintptr_t)engine->snapshot;
+  return engine->snapshot && (uintptr_t)ptr >= start && (uintptr_t)ptr < start + engine->snapshot_size;
+}
+
+// Containers loaded in place allocate through the engine, and leave the mapping on their first resize
+static void* snapshot_alloc(void* user, size_t size) {
+  Engine* engine = user;
+  return allocator_alloc(engine->allocator, size);
+}
+
+static void* snapshot_realloc(void* user, void* ptr, size_t old_size, size_t new_size) {
+  Engine* engine = user;
+  if (!snapshot_owns(engine, ptr)) { return allocator_realloc(engine->allocator, ptr, old_size, new_size); }
+  void* block = allocator_alloc(engine->allocator, new_size);
+  if (block) { memcpy(block, ptr, (old_size < new_size) ? old_size : new_size); }
+  return block;
+}
+
+static void snapshot_free(void* user, void* ptr, size_t size) {
+  Engine* engine = user;
+  if (!snapshot_owns(engine, ptr)) { allocator_free(engine->allocator, ptr, size); }
+}
+
+// Write bytes, advancing the file position
+static uint8_t snapshot_write(FILE* file, uint64_t* position, const void* data, size_t size) {
+  if (size > 0 && fwrite(data, 1, size, file) != size) { return 1; }
+  *position += size;
+  return 0;
+}
+
+// Write zeros up to the given file position
+static uint8_t snapshot_pad(FILE* file, uint64_t* position, uint64_t end) {
+  static const uint8_t zeros[MARS_SNAPSHOT_ALIGN] = { 0 };
+  while (*position < end) {
+    size_t size = (end - *position < sizeof(zeros)) ? (size_t)(end - *position) : sizeof(zeros);
+    if (snapshot_write(file, position, zeros, size) > 0) { return 1; }
+  }
+  return 0;
+}
+
+// Size of a vector trimmed to its length, keeping room for one element
+static size_t snapshot_vector_bytes(vector* vec) {
+  size_t capacity = (vec->length > 0) ? vec->length : 1;
+  return offsetof(vector, __buffer) + (vec->__element_size * capacity);
+}
+
+// Write a vector trimmed to its length, with a header that can be used in place
+static uint8_t snapshot_write_vector(FILE* file, uint64_t* position, vector* vec) {
+  vector header = *vec;
+  header.__capacity = (vec->length > 0) ? vec->length : 1;
+  header.__peak = snapshot_vector_bytes(vec);
+  header.__resizes = 0;
+  header.__allocator = NULL;
+  uint64_t end = *position + header.__peak;
+  if (snapshot_write(file, position, &header, offsetof(vector, __buffer)) > 0) { return 1; }
+  if (snapshot_write(file, position, vector_data(vec), vec->__element_size * vec->length) > 0) { return 1; }
+  return snapshot_pad(file, position, end);
+}
+
+// Write the entity slots, replacing each entity's archetype with its number (0 for none)
+static uint8_t snapshot_write_entities(FILE* file, uint64_t* position, Engine* engine, unordered_map* numbers) {
+  lot* entities = engine->entities;
+  lot header = *entities;
+  header.__peak = lot_bytes(entities);
+  header.__resizes = 0;
+  header.__allocator = NULL;
+  uint64_t end = *position + lot_bytes(entities);
+  uint8_t* nodes = __lot_node(entities, 0);
+  if (snapshot_write(file, position, &header, offsetof(lot, __buffer)) > 0) { return 1; }
+  if (snapshot_write(file, position, &entities->__buffer[0], (size_t)(nodes - &entities->__buffer[0])) > 0) { return 1; }
+
+  // Patch the slots a batch at a time, remembering the last archetype looked up
+  uint64_t stage[SNAPSHOT_STAGE / sizeof(uint64_t)];
+  size_t node_size = __lot_node_size(entities->__element_size);
+  size_t batch = sizeof(stage) / node_size;
+  Archetype* last = NULL;
+  uintptr_t last_number = 0;
+  for (size_t first = 0; first < entities->__capacity; first += batch) {
+    size_t count = (entities->__capacity - first < batch) ? entities->__capacity - first : batch;
+    memcpy(stage, nodes + (first * node_size), count * node_size);
+    for (size_t i = 0; i < count; ++i) {
+      uint8_t* node = (uint8_t*)stage + (i * node_size);
+      Entity* entity = (Entity*)(node + entities->__element_size);
+      if (!(*node & 0x80) || !entity->archetype) {
+        entity->archetype = NULL;
+        continue;
+      }
+      if (entity->archetype != last) {
+        last = entity->archetype;
+        last_number = *(size_t*)unordered_map_find(numbers, last->signature) + 1;
+      }
+      entity->archetype = (Archetype*)last_number;
+    }
+    if (snapshot_write(file, position, stage, count * node_size) > 0) { return 1; }
+  }
+  return snapshot_pad(file, position, end);
+}
+
+// Check that a section holds a whole vector with the given element size
+static uint8_t snapshot_check_vector(uint8_t* data, SnapshotSection* section, size_t element_size) {
+  if (section->size < offsetof(vector, __buffer)) { return 1; }
+  vector* vec = (vector*)(data + section->offset);
+  if (vec->__element_size != element_size || vec->__capacity == 0 || vec->length > vec->__capacity) { return 1; }
+  if (element_size > 0 && vec->__capacity > (section->size - offsetof(vector, __buffer)) / element_size) { return 1; }
+  return (section->size != vector_bytes(vec));
+}
+
+// Check that a section holds a whole entity slot array
+static uint8_t snapshot_check_entities(uint8_t* data, SnapshotSection* section) {
+  if (section->size < offsetof(lot, __buffer)) { return 1; }
+  lot* entities = (lot*)(data + section->offset);
+  if (entities->__element_size != sizeof(Entity) || entities->__capacity == 0 || entities->length > entities->__capacity ||
+      entities->__stack_head > entities->__capacity || entities->__capacity > __LOT_MAX_CAPACITY) { return 1; }
+  if (entities->__capacity > (section->size - offsetof(lot, __buffer)) / (sizeof(__lot_key_t) + __lot_node_size(sizeof(Entity)))) { return 1; }
+  if (section->size != lot_bytes(entities) || entities->__stack_head != entities->__capacity - entities->length) { return 1; }
+
+  // Free slots handed out by the next inserts must be in range
+  __lot_index_t* stack = (__lot_index_t*)&entities->__buffer[0];
+  for (size_t i = 0; i < entities->__stack_head; ++i) {
+    if (stack[i] >= entities->__capacity) { return 1; }
+  }
+  return 0;
+}
+
+// Check the layout of every section against the engine
+static uint8_t snapshot_check(Engine* engine, uint8_t* data, size_t size) {
+  // Header
+  SnapshotHeader* header = (SnapshotHeader*)data;
+  size_t systems = engine->system_order->length;
+  if (size < sizeof(SnapshotHeader) || memcmp(header->magic, MARS_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != MARS_SNAPSHOT_VERSION || header->order != MARS_SNAPSHOT_ORDER) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_load] Not a snapshot of this version!\n");
+    return 1;
+  }
+  if (header->id_size != sizeof(mars_id_t) || header->word_size != sizeof(size_t) || header->entity_size != sizeof(Entity)) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_load] Snapshot was written by a different build!\n");
+    return 1;
+  }
+  if (header->systems != systems) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_load] Snapshot has a different number of systems!\n");
+    return 1;
+  }
+  if (header->size != size || header->sections < 1 + (systems * 3) ||
+      header->sections > (size - sizeof(SnapshotHeader)) / sizeof(SnapshotSection)) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_load] Snapshot is truncated!\n");
+    return 1;
+  }
+
+  // Sections, in the order engine_save writes them
+  SnapshotSection* sections = (SnapshotSection*)(data + sizeof(SnapshotHeader));
+  for (size_t i = 0; i < header->sections; ++i) {
+    SnapshotSection* section = &sections[i];
+    uint32_t type = (i == 0) ? MARS_SECTION_ENTITIES : (i <= systems * 3) ? MARS_SECTION_SPARSE + (uint32_t)((i - 1) % 3) : MARS_SECTION_ARCHETYPE;
+    size_t index = (i == 0) ? 0 : (i <= systems * 3) ? (i - 1) / 3 : i - 1 - (systems * 3);
+    if (section->type != type || section->index != index || section->offset % MARS_SNAPSHOT_ALIGN != 0 ||
+        section->offset > size || section->size > size - section->offset) {
+      mars_dlog(MARS_VERB_ERROR, "[engine_load] Snapshot section is out of place!\n");
+      return 1;
+    }
+    System* system = (type != MARS_SECTION_ENTITIES && type != MARS_SECTION_ARCHETYPE) ? vector_get(engine->system_order, index, System*) : NULL;
+    uint8_t result = 0;
+    switch (type) {
+      case MARS_SECTION_ENTITIES: result = snapshot_check_entities(data, section); break;
+      case MARS_SECTION_SPARSE: result = snapshot_check_vector(data, section, sizeof(size_t)); break;
+      case MARS_SECTION_OWNERS: result = snapshot_check_vector(data, section, sizeof(mars_id_t)); break;
+      case MARS_SECTION_COMPONENTS:
+        if (section->info[0] != system->component_size || section->info[1] != system->storage) {
+          mars_dlog(MARS_VERB_ERROR, "[engine_load] System %zu does not match the snapshot!\n", index);
+          return 1;
+        }
+        result = snapshot_check_vector(data, section, system->component_size);
+        break;
+      case MARS_SECTION_ARCHETYPE: {
+        // Every bit must belong to an archetype-stored system, & each signature appear once
+        signature_t signature = (signature_t)section->info[0];
+        result = (signature == 0 || section->info[0] != signature);
+        for (size_t bit = 0; bit < MARS_MAX_COMPONENTS && result == 0; ++bit) {
+          if (signature & ((signature_t)1 << bit)) {
+            result = (bit >= systems || (vector_get(engine->system_order, bit, System*))->storage != MARS_STORAGE_ARCHETYPE);
+          }
+        }
+        for (size_t j = 1 + (systems * 3); j < i && result == 0; ++j) {
+          result = (sections[j].info[0] == section->info[0]);
+        }
+        break;
+      }
+    }
+    if (result > 0) {
+      mars_dlog(MARS_VERB_ERROR, "[engine_load] Snapshot section %zu is corrupt!\n", i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+/*=======================================================*/
+/* Engine                                                */
+/*=======================================================*/
+
+uint8_t engine_save(Engine* engine, const char* path) {
+  // Error check
+  if (!engine || !path) { return 1; }
+  MARS_TRACE_BEGIN("engine_save", 0);
+  size_t systems = engine->system_order->length;
+  size_t archetypes = engine->archetypes->length;
+  size_t count = 1 + (systems * 3) + archetypes;
+  SnapshotSection* sections = allocator_alloc(engine->allocator, sizeof(SnapshotSection) * count);
+  unordered_map* numbers = unordered_map_create_alloc(size_t, engine->allocator);
+  FILE* file = (sections && numbers) ? fopen(path, "wb") : NULL;
+  if (!file) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_save] Failed to open snapshot!\n");
+    allocator_free(engine->allocator, sections, sizeof(SnapshotSection) * count);
+    unordered_map_destroy(numbers);
+    MARS_TRACE_END("engine_save", 0);
+    return 1;
+  }
+
+  // Lay out the sections, each starting on an aligned offset
+  SnapshotSection empty = { 0 };
+  uint64_t offset = snapshot_align(sizeof(SnapshotHeader) + (sizeof(SnapshotSection) * count));
+  for (size_t i = 0; i < count; ++i) {
+    SnapshotSection* section = &sections[i];
+    *section = empty;
+    if (i == 0) {
+      section->type = MARS_SECTION_ENTITIES;
+      section->size = lot_bytes(engine->entities);
+    }
+    else if (i <= systems * 3) {
+      System* system = vector_get(engine->system_order, (i - 1) / 3, System*);
+      vector* storage[] = { system->sparse, system->components, system->entities };
+      section->type = MARS_SECTION_SPARSE + (uint32_t)((i - 1) % 3);
+      section->index = (uint32_t)((i - 1) / 3);
+      section->size = snapshot_vector_bytes(storage[(i - 1) % 3]);
+      if (section->type == MARS_SECTION_COMPONENTS) {
+        section->info[0] = system->component_size;
+        section->info[1] = system->storage;
+      }
+    }
+    else {
+      size_t number = i - 1 - (systems * 3);
+      Archetype* archetype = vector_get(engine->archetypes, number, Archetype*);
+      section->type = MARS_SECTION_ARCHETYPE;
+      section->index = (uint32_t)number;
+      section->size = (uint64_t)((archetype->length + archetype->chunk_capacity - 1) / archetype->chunk_capacity) * archetype->chunk_size;
+      section->info[0] = archetype->signature;
+      section->info[1] = archetype->length;
+      section->info[2] = archetype->chunk_size;
+      unordered_map_insert(numbers, archetype->signature, &number);
+    }
+    section->offset = offset;
+    offset = snapshot_align(offset + section->size);
+  }
+
+  // Header & section table
+  SnapshotHeader header = { 0 };
+  memcpy(header.magic, MARS_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = MARS_SNAPSHOT_VERSION;
+  header.order = MARS_SNAPSHOT_ORDER;
+  header.id_size = sizeof(mars_id_t);
+  header.word_size = sizeof(size_t);
+  header.entity_size = sizeof(Entity);
+  header.systems = (uint32_t)systems;
+  header.size = offset;
+  header.sections = count;
+  uint64_t position = 0;
+  uint8_t result = (numbers->length != archetypes);
+  result = result || snapshot_write(file, &position, &header, sizeof(header));
+  result = result || snapshot_write(file, &position, sections, sizeof(SnapshotSection) * count);
+
+  // Section contents
+  for (size_t i = 0; i < count && result == 0; ++i) {
+    result = snapshot_pad(file, &position, sections[i].offset);
+    if (result > 0) { break; }
+    if (i == 0) {
+      result = snapshot_write_entities(file, &position, engine, numbers);
+    }
+    else if (i <= systems * 3) {
+      System* system = vector_get(engine->system_order, (i - 1) / 3, System*);
+      vector* storage[] = { system->sparse, system->components, system->entities };
+      result = snapshot_write_vector(file, &position, storage[(i - 1) % 3]);
+    }
+    else {
+      Archetype* archetype = vector_get(engine->archetypes, sections[i].index, Archetype*);
+      size_t chunks = (size_t)(sections[i].size / archetype->chunk_size);
+      for (size_t c = 0; c < chunks && result == 0; ++c) {
+        result = snapshot_write(file, &position, vector_get(archetype->chunks, c, void*), archetype->chunk_size);
+      }
+    }
+  }
+  result = result || snapshot_pad(file, &position, offset);
+  result = (fclose(file) != 0) || result;
+  if (result > 0) { mars_dlog(MARS_VERB_ERROR, "[engine_save] Failed to write snapshot!\n"); }
+  allocator_free(engine->allocator, sections, sizeof(SnapshotSection) * count);
+  unordered_map_destroy(numbers);
+  MARS_TRACE_END("engine_save", 0);
+  return result;
+}
+
+uint8_t engine_load(Engine* engine, const char* path, uint8_t mode) {
+  // Error check
+  if (!engine || !path || mode > MARS_LOAD_MAP) { return 1; }
+  if (engine->entities->length > 0 || engine->snapshot) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_load] Engine already holds entities!\n");
+    return 1;
+  }
+  size_t size = 0;
+  uint8_t* data = mars_map_file(path, &size);
+  if (!data) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_load] Failed to map snapshot!\n");
+    return 1;
+  }
+  if (snapshot_check(engine, data, size) > 0) {
+    mars_unmap_file(data, size);
+    return 1;
+  }
+  MARS_TRACE_BEGIN("engine_load", mode);
+  SnapshotHeader* header = (SnapshotHeader*)data;
+  SnapshotSection* sections = (SnapshotSection*)(data + sizeof(SnapshotHeader));
+  size_t systems = engine->system_order->length;
+  size_t containers = 1 + (systems * 3);
+  size_t archetypes = (size_t)header->sections - containers;
+
+  // Archetypes are created up front with room for every row, their chunks are always copied
+  Archetype** tables = allocator_alloc(engine->allocator, sizeof(Archetype*) * (archetypes + 1));
+  void** blocks = allocator_alloc(engine->allocator, sizeof(void*) * containers);
+  uint8_t result = (!tables || !blocks);
+  for (size_t i = 0; i < archetypes && result == 0; ++i) {
+    SnapshotSection* section = &sections[containers + i];
+    Archetype* archetype = engine_get_archetype(engine, (signature_t)section->info[0]);
+    tables[i] = archetype;
+    result = (!archetype || archetype->length > 0 || archetype->chunk_size != section->info[2] || section->info[1] > SIZE_MAX - archetype->chunk_capacity ||
+      section->size != (uint64_t)((section->info[1] + archetype->chunk_capacity - 1) / archetype->chunk_capacity) * archetype->chunk_size);
+    result = result || archetype_reserve(archetype, (size_t)section->info[1]);
+  }
+
+  // Copy the slot array & system storage out of the mapping, or use them where they are
+  for (size_t i = 0; i < containers && result == 0; ++i) {
+    allocator* alloc = (i == 0) ? engine->allocator : (vector_get(engine->system_order, (i - 1) / 3, System*))->allocator;
+    blocks[i] = (mode == MARS_LOAD_MAP) ? data + sections[i].offset : allocator_alloc(alloc, (size_t)sections[i].size);
+    if (!blocks[i]) {
+      result = 1;
+      break;
+    }
+    if (mode == MARS_LOAD_COPY) { memcpy(blocks[i], data + sections[i].offset, (size_t)sections[i].size); }
+    if (i == 0) { ((lot*)blocks[i])->__allocator = (mode == MARS_LOAD_MAP) ? &engine->snapshot_allocator : alloc; }
+    else { ((vector*)blocks[i])->__allocator = (mode == MARS_LOAD_MAP) ? &engine->snapshot_allocator : alloc; }
+  }
+
+  // Turn archetype numbers back into pointers
+  lot* entities = (result == 0) ? blocks[0] : NULL;
+  for (size_t index = 0; entities && index < entities->__capacity && result == 0; ++index) {
+    if (!(*__lot_node_ctrl(entities, index) & 0x80)) { continue; }
+    Entity* entity = __lot_node_data(entities, index);
+    uintptr_t number = (uintptr_t)entity->archetype;
+    if (number == 0) { continue; }
+    result = (number > archetypes || entity->row >= sections[containers + number - 1].info[1]);
+    entity->archetype = (result == 0) ? tables[number - 1] : NULL;
+  }
+  if (result > 0) {
+    mars_dlog(MARS_VERB_ERROR, "[engine_load] Failed to restore snapshot!\n");
+    for (size_t i = 0; blocks && mode == MARS_LOAD_COPY && i < containers; ++i) {
+      allocator* alloc = (i == 0) ? engine->allocator : (vector_get(engine->system_order, (i - 1) / 3, System*))->allocator;
+      if (blocks[i]) { allocator_free(alloc, blocks[i], (size_t)sections[i].size); }
+      blocks[i] = NULL;
+    }
+    if (tables) { allocator_free(engine->allocator, tables, sizeof(Archetype*) * (archetypes + 1)); }
+    if (blocks) { allocator_free(engine->allocator, blocks, sizeof(void*) * containers); }
+    mars_unmap_file(data, size);
+    MARS_TRACE_END("engine_load", mode);
+    return 1;
+  }
+
+  // Nothing can fail past this point, swap the loaded containers in
+  if (mode == MARS_LOAD_MAP) {
+    engine->snapshot = data;
+    engine->snapshot_size = size;
+    engine->snapshot_allocator.alloc = snapshot_alloc;
+    engine->snapshot_allocator.realloc = snapshot_realloc;
+    engine->snapshot_allocator.free = snapshot_free;
+    engine->snapshot_allocator.user = engine;
+  }
+  lot_destroy(engine->entities);
+  engine->entities = blocks[0];
+  for (size_t s = 0; s < systems; ++s) {
+    System* system = vector_get(engine->system_order, s, System*);
+    vector_destroy(system->sparse);
+    vector_destroy(system->components);
+    vector_destroy(system->entities);
+    system->sparse = blocks[1 + (s * 3)];
+    system->components = blocks[2 + (s * 3)];
+    system->entities = blocks[3 + (s * 3)];
+  }
+  for (size_t i = 0; i < archetypes; ++i) {
+    SnapshotSection* section = &sections[containers + i];
+    Archetype* archetype = tables[i];
+    size_t chunks = (size_t)(section->size / archetype->chunk_size);
+    for (size_t c = 0; c < chunks; ++c) {
+      memcpy(vector_get(archetype->chunks, c, void*), data + section->offset + (c * archetype->chunk_size), archetype->chunk_size);
+    }
+    archetype->length = (size_t)section->info[1];
+  }
+  allocator_free(engine->allocator, tables, sizeof(Archetype*) * (archetypes + 1));
+  allocator_free(engine->allocator, blocks, sizeof(void*) * containers);
+  if (mode == MARS_LOAD_COPY) { mars_unmap_file(data, size); }
+  MARS_TRACE_END("engine_load", mode);
+  return 0;
+}
\ No newline at end of file
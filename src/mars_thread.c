@@ -0,0 +1,356 @@
+#ifndef MARS_EXPORTS
+  #define MARS_EXPORTS
+#endif
+#include "mars/mars_core.h"
+#include "mars/mars_trace.h"
+
+/*=======================================================*/
+/* Definitions                                           */
+/*=======================================================*/
+static MARS_THREAD_LOCAL size_t __mars_thread_index = 0;
+
+
+/*=======================================================*/
+/* Environment-specific code                             */
+/*=======================================================*/
+#if defined(_WIN32)
+  #define mars_mutex_init(m) InitializeSRWLock(m)
+  #define mars_mutex_destroy(m)
+  #define mars_mutex_lock(m) AcquireSRWLockExclusive(m)
+  #define mars_mutex_unlock(m) ReleaseSRWLockExclusive(m)
+  #define mars_cond_init(c) InitializeConditionVariable(c)
+  #define mars_cond_destroy(c)
+  #define mars_cond_wait(c, m) SleepConditionVariableSRW(c, m, INFINITE, 0)
+  #define mars_cond_broadcast(c) WakeAllConditionVariable(c)
+  #define mars_cond_signal(c) WakeConditionVariable(c)
+  #define mars_thread_yield() SwitchToThread()
+#else
+  #include <sched.h>
+  #define mars_mutex_init(m) pthread_mutex_init(m, NULL)
+  #define mars_mutex_destroy(m) pthread_mutex_destroy(m)
+  #define mars_mutex_lock(m) pthread_mutex_lock(m)
+  #define mars_mutex_unlock(m) pthread_mutex_unlock(m)
+  #define mars_cond_init(c) pthread_cond_init(c, NULL)
+  #define mars_cond_destroy(c) pthread_cond_destroy(c)
+  #define mars_cond_wait(c, m) pthread_cond_wait(c, m)
+  #define mars_cond_broadcast(c) pthread_cond_broadcast(c)
+  #define mars_cond_signal(c) pthread_cond_signal(c)
+  #define mars_thread_yield() sched_yield()
+#endif
+
+
+/*=======================================================*/
+/* Thread Pool                                           */
+/*=======================================================*/
+
+// Pop the next queued job, returns false if the queue is empty. Lock must be held.
+static bool thread_pool_pop(ThreadPool* pool, ThreadJob* job) {
+  if (pool->head >= pool->jobs->length) { return false; }
+  memcpy(job, vector_at(pool->jobs, pool->head), sizeof(*job));
+  pool->head++;
+
+  // Rewind once the queue drains so it never grows in steady state
+  if (pool->head >= pool->jobs->length) {
+    pool->head = 0;
+    pool->jobs->length = 0;
+  }
+  return true;
+}
+
+// Run a job and signal its completion
+static void thread_pool_run(ThreadJob* job) {
+  job->func(job->num, job->args);
+  if (job->pending) {
+    mars_atomic_add(job->pending, (size_t)-1);
+  }
+}
+
+// Entry point of every worker thread
+static void thread_pool_worker(ThreadPool* pool, size_t index) {
+  __mars_thread_index = index;
+  ThreadJob job;
+  mars_mutex_lock(&pool->lock);
+  while (1) {
+    // Sleep until there is work or the pool stops
+    while (pool->run && pool->head >= pool->jobs->length) {
+      mars_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (!thread_pool_pop(pool, &job)) { break; }
+
+    // Run outside of the lock
+    mars_mutex_unlock(&pool->lock);
+    thread_pool_run(&job);
+    mars_mutex_lock(&pool->lock);
+  }
+  mars_mutex_unlock(&pool->lock);
+  mars_trace_release();
+}
+
+// Per-thread startup arguments
+typedef struct {
+  ThreadPool* pool;
+  size_t index;
+} ThreadStart;
+
+#if defined(_WIN32)
+  static DWORD WINAPI thread_pool_entry(LPVOID arg) {
+    ThreadStart start = *(ThreadStart*)arg;
+    free(arg);
+    thread_pool_worker(start.pool, start.index);
+    return 0;
+  }
+#else
+  static void* thread_pool_entry(void* arg) {
+    ThreadStart start = *(ThreadStart*)arg;
+    free(arg);
+    thread_pool_worker(start.pool, start.index);
+    return NULL;
+  }
+#endif
+
+ThreadPool* thread_pool_create(size_t thread_count) {
+  // Assign default values
+  ThreadPool* pool = malloc(sizeof(*pool));
+  if (!pool) { return NULL; }
+  pool->threads = malloc(sizeof(mars_thread_t) * (thread_count > 0 ? thread_count : 1));
+  pool->jobs = vector_create(ThreadJob);
+  if (!pool->threads || !pool->jobs) {
+    free(pool->threads);
+    vector_destroy(pool->jobs);
+    free(pool);
+    return NULL;
+  }
+  pool->thread_count = 0;
+  pool->head = 0;
+  pool->run = true;
+  mars_mutex_init(&pool->lock);
+  mars_cond_init(&pool->wake);
+
+  // Start workers
+  for (size_t i = 0; i < thread_count; ++i) {
+    ThreadStart* start = malloc(sizeof(*start));
+    if (!start) { break; }
+    start->pool = pool;
+    start->index = i + 1;
+    #if defined(_WIN32)
+      pool->threads[i] = CreateThread(NULL, 0, thread_pool_entry, start, 0, NULL);
+      if (!pool->threads[i]) { free(start); break; }
+    #else
+      if (pthread_create(&pool->threads[i], NULL, thread_pool_entry, start) != 0) { free(start); break; }
+    #endif
+    pool->thread_count++;
+  }
+  if (pool->thread_count < thread_count) {
+    mars_dlog(MARS_VERB_WARNING, "[thread_pool_create] Started %zu of %zu threads!\n", pool->thread_count, thread_count);
+  }
+  return pool;
+}
+
+// Queue copies of a job under a single lock, returns the number queued
+static size_t thread_pool_push(ThreadPool* pool, fptr_t func, size_t num, void** args, volatile size_t* pending, size_t copies) {
+  // Build job
+  ThreadJob job;
+  job.func = func;
+  job.num = num;
+  job.pending = pending;
+  for (size_t i = 0; i < num; ++i) {
+    job.args[i] = args[i];
+  }
+
+  // Queue jobs
+  size_t queued = 0;
+  if (pending) {
+    mars_atomic_add(pending, copies);
+  }
+  mars_mutex_lock(&pool->lock);
+  while (queued < copies && vector_push_back(pool->jobs, &job) == 0) {
+    queued++;
+  }
+  mars_mutex_unlock(&pool->lock);
+  if (pending && queued < copies) {
+    mars_atomic_add(pending, queued - copies);
+  }
+
+  // Wake workers
+  if (queued > 1) {
+    mars_cond_broadcast(&pool->wake);
+  }
+  else if (queued == 1) {
+    mars_cond_signal(&pool->wake);
+  }
+  return queued;
+}
+
+uint8_t thread_pool_submit(ThreadPool* pool, fptr_t func, size_t num, void** args, volatile size_t* pending) {
+  // Error check
+  if (!pool || !func || num > MARS_JOB_ARGS) { return 1; }
+  return (thread_pool_push(pool, func, num, args, pending, 1) == 1) ? 0 : 1;
+}
+
+void thread_pool_wait(ThreadPool* pool, volatile size_t* pending) {
+  // Error check
+  if (!pool || !pending) { return; }
+
+  // Help out with queued jobs until ours are done
+  ThreadJob job;
+  while (mars_atomic_load(pending) > 0) {
+    mars_mutex_lock(&pool->lock);
+    bool found = thread_pool_pop(pool, &job);
+    mars_mutex_unlock(&pool->lock);
+    if (found) {
+      thread_pool_run(&job);
+    }
+    else {
+      mars_thread_yield();
+    }
+  }
+}
+
+// Range owned by one parallel-for participant, aligned & padded to its own cache line so
+// the ThreadParallel holding them (a stack local) never shares a line between two ranges
+typedef struct {
+  MARS_ALIGN(64) volatile size_t lock;  // Spinlock guarding lo & hi
+  size_t lo;                      // Next index to run (owner takes from the front)
+  size_t hi;                      // End of the range (thieves take from the back)
+  uint8_t __pad[64 - (3 * sizeof(size_t))];
+} ThreadRange;
+
+// Shared state of one parallel-for call
+typedef struct {
+  ThreadRange ranges[MARS_PARALLEL_SLOTS];
+  size_t slots;                   // Number of ranges in use
+  volatile size_t next_slot;      // Next range handed to a joining thread
+  size_t grain;                   // Maximum indices per chunk
+  fptr_t func;                    // Function run on each chunk
+  size_t num;                     // Number of user arguments
+  void* args[MARS_JOB_ARGS + 2];  // {&begin, &end, user arguments...}
+} ThreadParallel;
+
+#define thread_range_lock(r) while (!mars_atomic_cas(&(r)->lock, 0, 1)) { mars_thread_yield(); }
+#define thread_range_unlock(r) mars_atomic_store(&(r)->lock, 0)
+
+// Take the next chunk from the front of a range, returns false if the range is empty
+static bool thread_range_take(ThreadRange* range, size_t grain, size_t* begin, size_t* end) {
+  thread_range_lock(range);
+  bool found = range->lo < range->hi;
+  if (found) {
+    *begin = range->lo;
+    *end = (range->hi - range->lo > grain) ? range->lo + grain : range->hi;
+    range->lo = *end;
+  }
+  thread_range_unlock(range);
+  return found;
+}
+
+// Steal the back half of another range into our own, returns false if there was nothing to steal
+static bool thread_range_steal(ThreadParallel* par, size_t slot) {
+  for (size_t i = 1; i < par->slots; ++i) {
+    ThreadRange* victim = &par->ranges[(slot + i) % par->slots];
+    thread_range_lock(victim);
+    size_t lo = victim->lo;
+    size_t hi = victim->hi;
+    if (lo < hi) {
+      size_t mid = (hi - lo > par->grain) ? lo + ((hi - lo) / 2) : lo;
+      victim->hi = mid;
+      thread_range_unlock(victim);
+
+      // Adopt the stolen half
+      ThreadRange* own = &par->ranges[slot];
+      thread_range_lock(own);
+      own->lo = mid;
+      own->hi = hi;
+      thread_range_unlock(own);
+      return true;
+    }
+    thread_range_unlock(victim);
+  }
+  return false;
+}
+
+// Run chunks until no range has work left
+static uint8_t thread_parallel_job(size_t num, void** args) {
+  ThreadParallel* par = (ThreadParallel*)args[0];
+  size_t slot = mars_atomic_add(&par->next_slot, 1) - 1;
+  if (slot >= par->slots) { return 0; }
+
+  // Work through our own range, then steal
+  size_t begin, end;
+  void* call[MARS_JOB_ARGS + 2];
+  memcpy(call, par->args, sizeof(call));
+  call[0] = &begin;
+  call[1] = &end;
+  do {
+    while (thread_range_take(&par->ranges[slot], par->grain, &begin, &end)) {
+      par->func(par->num + 2, call);
+    }
+  } while (thread_range_steal(par, slot));
+  return 0;
+}
+
+void thread_pool_parallel_for(ThreadPool* pool, size_t count, size_t grain, fptr_t func, size_t num, void** args) {
+  // Error check
+  if (!func || count == 0 || num > MARS_JOB_ARGS) { return; }
+  if (grain == 0) { grain = 1; }
+
+  // Use one range per thread, but never more ranges than chunks
+  size_t slots = (pool) ? pool->thread_count + 1 : 1;
+  size_t chunks = (count + grain - 1) / grain;
+  if (slots > chunks) { slots = chunks; }
+  if (slots > MARS_PARALLEL_SLOTS) { slots = MARS_PARALLEL_SLOTS; }
+
+  // Split the range evenly
+  ThreadParallel par;
+  par.slots = slots;
+  par.next_slot = 0;
+  par.grain = grain;
+  par.func = func;
+  par.num = num;
+  for (size_t i = 0; i < num; ++i) {
+    par.args[i + 2] = args[i];
+  }
+  for (size_t i = 0; i < slots; ++i) {
+    par.ranges[i].lock = 0;
+    par.ranges[i].lo = (count * i) / slots;
+    par.ranges[i].hi = (count * (i + 1)) / slots;
+  }
+
+  // Let the workers join in, then take part on this thread
+  volatile size_t pending = 0;
+  void* job_args[] = {&par};
+  if (pool && slots > 1) {
+    thread_pool_push(pool, thread_parallel_job, 1, job_args, &pending, slots - 1);
+  }
+  thread_parallel_job(1, job_args);
+
+  // Every chunk has been claimed, wait for the helpers still running theirs
+  thread_pool_wait(pool, &pending);
+}
+
+void thread_pool_destroy(ThreadPool* pool) {
+  if (pool) {
+    // Wake everyone up and let the queue drain
+    mars_mutex_lock(&pool->lock);
+    pool->run = false;
+    mars_mutex_unlock(&pool->lock);
+    mars_cond_broadcast(&pool->wake);
+
+    // Join workers
+    for (size_t i = 0; i < pool->thread_count; ++i) {
+      #if defined(_WIN32)
+        WaitForSingleObject(pool->threads[i], INFINITE);
+        CloseHandle(pool->threads[i]);
+      #else
+        pthread_join(pool->threads[i], NULL);
+      #endif
+    }
+    mars_cond_destroy(&pool->wake);
+    mars_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    vector_destroy(pool->jobs);
+  }
+  free(pool);
+}
+
+size_t mars_thread_index() {
+  return __mars_thread_index;
+}
\ No newline at end of file
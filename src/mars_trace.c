@@ -0,0 +1,159 @@
+#ifndef MARS_EXPORTS
+  #define MARS_EXPORTS
+#endif
+#include "mars/mars_trace.h"
+
+#ifdef MARS_TRACE
+/*=======================================================*/
+/* Definitions                                           */
+/*=======================================================*/
+static TraceRing trace_rings[MARS_TRACE_THREADS];   // Ring of each thread, claimed on first use
+static volatile size_t trace_dropped = 0;           // Events lost because every ring was owned
+static volatile size_t trace_enabled = 0;           // Set while a trace file is open
+static volatile size_t trace_lock = 0;              // Held while opening, flushing or closing
+static FILE* trace_file = NULL;                     // Trace being written
+static uint64_t trace_start = 0;                    // Time the trace was opened, events are relative to it
+static bool trace_first = true;                     // No event written yet
+static MARS_THREAD_LOCAL size_t trace_slot = 0;     // Ring of the calling thread plus one (0 until claimed)
+
+// Take the trace lock, spinning while another thread holds it
+static void trace_acquire() {
+  while (!mars_atomic_cas(&trace_lock, 0, 1)) {}
+}
+
+// Release the trace lock
+static void trace_release() {
+  mars_atomic_store(&trace_lock, 0);
+}
+
+// Claim a ring no other thread owns, returns its slot (0 if every ring is owned)
+static size_t trace_claim() {
+  for (size_t r = 0; r < MARS_TRACE_THREADS; ++r) {
+    if (!mars_atomic_load(&trace_rings[r].owned) && mars_atomic_cas(&trace_rings[r].owned, 0, 1)) {
+      return r + 1;
+    }
+  }
+  return 0;
+}
+
+// Write out the events of every ring, the lock must be held
+static void trace_drain() {
+  for (size_t r = 0; r < MARS_TRACE_THREADS; ++r) {
+    TraceRing* ring = &trace_rings[r];
+    size_t head = mars_atomic_load(&ring->head);
+    for (size_t i = ring->tail; i < head; ++i) {
+      TraceEvent* event = &ring->events[i % MARS_TRACE_EVENTS];
+      double time = (event->time > trace_start) ? (double)(event->time - trace_start) * 1e-3 : 0.0;
+      fprintf(trace_file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%zu,\"args\":{\"id\":%llu}}",
+        (trace_first) ? "" : ",", event->name, event->phase, time, r, (unsigned long long)event->id);
+      trace_first = false;
+    }
+    mars_atomic_store(&ring->tail, head);
+  }
+}
+
+
+/*=======================================================*/
+/* Trace                                                 */
+/*=======================================================*/
+
+void mars_trace_event(const char* name, char phase, uint64_t id) {
+  if (!mars_atomic_load(&trace_enabled)) { return; }
+
+  // Claim a ring on first use, retrying on later events until one is released
+  if (trace_slot == 0) {
+    trace_slot = trace_claim();
+    if (trace_slot == 0) {
+      mars_atomic_add(&trace_dropped, 1);
+      return;
+    }
+  }
+
+  // Append unless the flushes fell behind
+  TraceRing* ring = &trace_rings[trace_slot - 1];
+  size_t head = ring->head;
+  if (head - mars_atomic_load(&ring->tail) >= MARS_TRACE_EVENTS) {
+    mars_atomic_add(&ring->dropped, 1);
+    return;
+  }
+  TraceEvent* event = &ring->events[head % MARS_TRACE_EVENTS];
+  event->name = name;
+  event->time = mars_time_ns();
+  event->id = id;
+  event->phase = phase;
+  mars_atomic_store(&ring->head, head + 1);
+}
+
+void mars_trace_release() {
+  if (trace_slot == 0) { return; }
+
+  // Recorded events stay in the ring until the next flush writes them out
+  mars_atomic_store(&trace_rings[trace_slot - 1].owned, 0);
+  trace_slot = 0;
+}
+
+uint8_t mars_trace_open(const char* path) {
+  // Error check
+  if (!path) { return 1; }
+  trace_acquire();
+  if (trace_file) {
+    trace_release();
+    mars_dlog(MARS_VERB_ERROR, "[mars_trace_open] A trace is already open!\n");
+    return 1;
+  }
+
+  // Start the array, the closing bracket is optional in the trace format
+  trace_file = fopen(path, "w");
+  if (!trace_file) {
+    trace_release();
+    mars_dlog(MARS_VERB_ERROR, "[mars_trace_open] Failed to open %s!\n", path);
+    return 1;
+  }
+  fprintf(trace_file, "[");
+  trace_first = true;
+  trace_start = mars_time_ns();
+
+  // Skip anything recorded by an earlier trace
+  for (size_t r = 0; r < MARS_TRACE_THREADS; ++r) {
+    mars_atomic_store(&trace_rings[r].tail, mars_atomic_load(&trace_rings[r].head));
+    mars_atomic_store(&trace_rings[r].dropped, 0);
+  }
+  mars_atomic_store(&trace_dropped, 0);
+  mars_atomic_store(&trace_enabled, 1);
+  trace_release();
+  return 0;
+}
+
+uint8_t mars_trace_flush() {
+  trace_acquire();
+  if (!trace_file) {
+    trace_release();
+    return 1;
+  }
+  trace_drain();
+  uint8_t result = (fflush(trace_file) != 0) ? 1 : 0;
+  trace_release();
+  return result;
+}
+
+size_t mars_trace_close() {
+  trace_acquire();
+  if (!trace_file) {
+    trace_release();
+    return 0;
+  }
+
+  // Stop recording, write out what is left & finish the array
+  mars_atomic_store(&trace_enabled, 0);
+  trace_drain();
+  fprintf(trace_file, "\n]\n");
+  fclose(trace_file);
+  trace_file = NULL;
+  size_t dropped = mars_atomic_load(&trace_dropped);
+  for (size_t r = 0; r < MARS_TRACE_THREADS; ++r) {
+    dropped += mars_atomic_load(&trace_rings[r].dropped);
+  }
+  trace_release();
+  return dropped;
+}
+#endif
\ No newline at end of file